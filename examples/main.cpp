@@ -46,7 +46,10 @@ int main(int argc, char** argv) {
     //params.floating = GLFW_TRUE;
     //params.resizable = GLFW_FALSE;
     params.swap_interval = 1;
+    //params.direct_state_access = true;
     Context::init(params);
+    ShaderImpl::set_program_cache_dir("shader_cache");
+    shader_watcher_start();
 
     // setup fbo
     const glm::ivec2 res = Context::resolution();
@@ -57,6 +60,14 @@ int main(int argc, char** argv) {
 
     // setup draw shader
     Shader("draw", "shader/draw.vs", "shader/draw.fs");
+    Shader("draw_batched", "shader/draw_batched.vs", "shader/draw.fs");
+    Shader("draw_compressed", "shader/draw_compressed.vs", "shader/draw.fs");
+    Shader("draw_batched_compressed", "shader/draw_batched_compressed.vs", "shader/draw.fs");
+    BatchRenderer batch_renderer("example_batch_renderer");
+    RenderQueue render_queue("example_render_queue");
+    FrustumCuller culler("example_culler");
+    OcclusionCuller occlusion_culler("example_occlusion_culler");
+    std::vector<Drawelement> batched_drawelements; // parallel to culler->drawelements
     Shader fallbackShader = Shader("fallback", "shader/quad.vs", "shader/fallback.fs");
 
     // setup compute shader
@@ -68,7 +79,16 @@ int main(int argc, char** argv) {
     Context::set_keyboard_callback(keyboard_callback);
     Context::set_mouse_button_callback(mouse_button_callback);
     static bool doGreyscaleComputeShaderExample = false;
-    gui_add_callback("example_gui_callback", [] { ImGui::ShowMetricsWindow(); ImGui::Checkbox("compute shader example: convert to greyscale", &doGreyscaleComputeShaderExample); });
+    static bool doBatchedRendering = false;
+    static bool doFrustumCulling = true;
+    static bool doOcclusionCulling = false;
+    gui_add_callback("example_gui_callback", [] {
+        ImGui::ShowMetricsWindow();
+        ImGui::Checkbox("compute shader example: convert to greyscale", &doGreyscaleComputeShaderExample);
+        ImGui::Checkbox("batched rendering (multi-draw-indirect)", &doBatchedRendering);
+        ImGui::Checkbox("frustum culling", &doFrustumCulling);
+        ImGui::Checkbox("occlusion culling (hi-z, batched only)", &doOcclusionCulling);
+    });
 
     // parse cmd line args
     for (int i = 1; i < argc; ++i) {
@@ -87,9 +107,14 @@ int main(int argc, char** argv) {
             current_camera()->dir.z = std::stof(argv[++i]);
         } else if (arg == "-fov")
             current_camera()->fov_degree = std::stof(argv[++i]);
+        else if (arg == "-compressed")
+            MeshImpl::default_vertex_format = VertexFormat::compressed();
         else {
-            for (auto& mesh : load_meshes_gpu(argv[i], true))
-                Drawelement(mesh->name, Shader::find("draw"), mesh);
+            for (auto& mesh : load_meshes_gpu(argv[i], true)) {
+                const bool compressed = mesh->vertex_format.normal == NormalEncoding::OCTAHEDRAL_SNORM16 && mesh->geometry->has_normals();
+                culler->add(Drawelement(mesh->name, Shader::find(compressed ? "draw_compressed" : "draw"), mesh));
+                batched_drawelements.push_back(Drawelement(mesh->name + "_batched", Shader::find(compressed ? "draw_batched_compressed" : "draw_batched"), mesh));
+            }
         }
     }
 
@@ -115,13 +140,29 @@ int main(int argc, char** argv) {
             Quad::draw();
             fallbackShader->unbind();
         } else {
-            for (const auto& [key, drawelement] : Drawelement::map) {
-                drawelement->bind();
-                drawelement->draw();
-                drawelement->unbind();
+            if (doFrustumCulling)
+                culler->cull();
+            if (doBatchedRendering) {
+                batch_renderer->clear();
+                if (doFrustumCulling)
+                    for (uint32_t i : culler->visible_indices)
+                        batch_renderer->add(batched_drawelements[i]);
+                else
+                    for (const auto& drawelement : batched_drawelements)
+                        batch_renderer->add(drawelement);
+                batch_renderer->occlusion_culler = doOcclusionCulling ? occlusion_culler : OcclusionCuller();
+                batch_renderer->draw();
+            } else {
+                // sorted by state and depth to minimize switches and overdraw
+                render_queue->clear();
+                for (const auto& drawelement : doFrustumCulling ? culler->visible : culler->drawelements)
+                    render_queue->add(drawelement);
+                render_queue->draw();
             }
         }
         fbo->unbind();
+        if (doOcclusionCulling)
+            occlusion_culler->build_pyramid(fbo->depth_texture);
 
         if (doGreyscaleComputeShaderExample) {
             computeShaderExample->bind();
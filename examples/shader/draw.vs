@@ -1,13 +1,11 @@
 #version 330
+#include "frame_uniforms.glsl"
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec3 in_norm;
 layout (location = 2) in vec2 in_tc;
 
 uniform mat4 model;
 uniform mat4 model_normal;
-uniform mat4 view;
-uniform mat4 view_normal;
-uniform mat4 proj;
 
 out vec4 pos_wc;
 out vec3 norm_wc;
@@ -0,0 +1,26 @@
+#version 460
+#include "frame_uniforms.glsl"
+layout (location = 0) in vec3 in_pos;
+layout (location = 1) in vec3 in_norm;
+layout (location = 2) in vec2 in_tc;
+
+struct Instance {
+    mat4 model;
+    mat4 model_normal;
+};
+
+layout (std430, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+out vec4 pos_wc;
+out vec3 norm_wc;
+out vec2 tc;
+
+void main() {
+    const Instance instance = instances[gl_BaseInstance + gl_InstanceID];
+    pos_wc = instance.model * vec4(in_pos, 1.0);
+    norm_wc = normalize(mat3(instance.model_normal) * in_norm) * 0.5 + 0.5;
+    tc = in_tc;
+    gl_Position = proj * view * pos_wc;
+}
@@ -0,0 +1,20 @@
+#version 330
+#include "vertex_format.glsl"
+#include "frame_uniforms.glsl"
+layout (location = 0) in vec3 in_pos;
+layout (location = 1) in vec2 in_norm_oct;
+layout (location = 2) in vec2 in_tc;
+
+uniform mat4 model;
+uniform mat4 model_normal;
+
+out vec4 pos_wc;
+out vec3 norm_wc;
+out vec2 tc;
+
+void main() {
+    pos_wc = model * vec4(in_pos, 1.0);
+    norm_wc = normalize(mat3(model_normal) * decode_octahedral(in_norm_oct)) * 0.5 + 0.5;
+    tc = in_tc;
+    gl_Position = proj * view * pos_wc;
+}
@@ -0,0 +1,117 @@
+#include "batch_renderer.h"
+#include "camera.h"
+#include "frame_uniforms.h"
+#include <tuple>
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+// ----------------------------------------------------
+// helper funcs
+
+static inline auto batch_key(const DrawelementImpl* elem) {
+    return std::make_tuple(elem->shader.ptr.get(), elem->mesh->material.ptr.get(), elem->mesh->vertex_array(), elem->mesh->primitive_type);
+}
+
+// ----------------------------------------------------
+// BatchRenderer
+
+BatchRendererImpl::BatchRendererImpl(const std::string& name)
+    : name(name), stream_buffer(StreamBuffer(name + "/stream")), num_batches(0), num_commands(0) {}
+
+BatchRendererImpl::~BatchRendererImpl() {}
+
+void BatchRendererImpl::add(const Drawelement& elem) {
+    drawelements.push_back(elem);
+}
+
+void BatchRendererImpl::clear() {
+    drawelements.clear();
+}
+
+void BatchRendererImpl::draw() {
+    // sort by batch key, then by mesh and level of detail to merge instances into a single command
+    const Camera cam = current_camera();
+    sorted.clear();
+    for (const auto& elem : drawelements) {
+        if (!elem->shader || !elem->mesh || !elem->shader->ready()) continue;
+        if (!elem->mesh->ibo && !(elem->mesh->arena && elem->mesh->num_indices > 0)) { // not indexed, use regular path
+            elem->bind();
+            elem->draw();
+            elem->unbind();
+            continue;
+        }
+        sorted.emplace_back(&*elem, elem->mesh->select_lod(elem->model, cam, DrawelementImpl::lod_threshold));
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        const auto key_a = batch_key(a.first), key_b = batch_key(b.first);
+        if (key_a != key_b) return key_a < key_b;
+        return a.first->mesh.ptr != b.first->mesh.ptr ? a.first->mesh.ptr.get() < b.first->mesh.ptr.get() : a.second < b.second;
+    });
+
+    // build instance data, indirect commands and batches (no instance merging with occlusion culling)
+    const bool occlusion_culling = bool(occlusion_culler);
+    instances.resize(sorted.size());
+    commands.clear();
+    bounds.clear();
+    batches.clear();
+    for (uint32_t i = 0; i < sorted.size(); ++i) {
+        const DrawelementImpl* elem = sorted[i].first;
+        const uint32_t lod = sorted[i].second;
+        instances[i].model = elem->model * elem->mesh->position_decode;
+        instances[i].model_normal = glm::transpose(glm::inverse(elem->model));
+        const bool new_batch = i == 0 || batch_key(sorted[i - 1].first) != batch_key(elem);
+        if (!new_batch && !occlusion_culling && sorted[i - 1].first->mesh.ptr == elem->mesh.ptr && sorted[i - 1].second == lod) {
+            commands.back().instance_count++;
+            continue;
+        }
+        const MeshLod level = lod < elem->mesh->lods.size() ? elem->mesh->lods[lod] : MeshLod{ 0, elem->mesh->num_indices, 0.f };
+        commands.push_back(DrawElementsIndirectCommand{ level.num_indices, 1, elem->mesh->allocation.first_index + level.first_index,
+                int32_t(elem->mesh->allocation.base_vertex), i });
+        if (occlusion_culling) {
+            glm::vec3 lower, upper;
+            transform_bounds(elem->model, elem->mesh->bb_min, elem->mesh->bb_max, lower, upper);
+            bounds.push_back(glm::vec4(lower, 1.f));
+            bounds.push_back(glm::vec4(upper, 1.f));
+        }
+        if (new_batch)
+            batches.push_back(Batch{ elem, uint32_t(commands.size() - 1), 0 });
+        batches.back().num_commands++;
+    }
+    num_batches = uint32_t(batches.size());
+    num_commands = uint32_t(commands.size());
+    if (batches.empty()) return;
+
+    // upload into the persistently mapped ring (no implicit syncs)
+    const StreamAllocation instance_alloc = stream_buffer->upload(instances);
+    const StreamAllocation command_alloc = stream_buffer->upload(commands);
+    if (occlusion_culling)
+        occlusion_culler->cull(bounds, command_alloc);
+
+    // draw batches, camera matrices are only set on shader changes (if not in FrameUniforms)
+    frame_uniforms_bind();
+    instance_alloc.bind_range(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING);
+    command_alloc.bind(GL_DRAW_INDIRECT_BUFFER);
+    const ShaderImpl* bound_shader = 0;
+    for (const auto& batch : batches) {
+        const DrawelementImpl* elem = batch.elem;
+        if (bound_shader != elem->shader.ptr.get()) {
+            elem->shader->bind();
+            if (!elem->shader->frame_uniforms_block) {
+                elem->shader->uniform("view", cam->view);
+                elem->shader->uniform("view_normal", cam->view_normal);
+                elem->shader->uniform("proj", cam->proj);
+            }
+            bound_shader = elem->shader.ptr.get();
+        }
+        elem->mesh->bind(elem->shader);
+        glMultiDrawElementsIndirect(elem->mesh->primitive_type, GL_UNSIGNED_INT,
+                (const void*)(command_alloc.offset + batch.first_command * sizeof(DrawElementsIndirectCommand)), batch.num_commands, 0);
+        elem->mesh->unbind();
+    }
+    GLState::use_program(0);
+    GLState::bind_buffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    GLState::bind_buffer_base(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, 0);
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include "named_handle.h"
+#include "drawelement.h"
+#include "buffer.h"
+#include "culling.h"
+#include "stream_buffer.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Indirect draw command layout (as expected by glMultiDrawElementsIndirect)
+
+struct DrawElementsIndirectCommand {
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+};
+
+// ------------------------------------------
+// Per-instance data (std430 layout, indexed via gl_BaseInstance + gl_InstanceID)
+
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat4 model_normal;
+};
+
+// ------------------------------------------
+// BatchRenderer
+// Groups drawelements by shader, material and vertex array, uploads per-instance matrices into a SSBO
+// and submits each group with a single glMultiDrawElementsIndirect call.
+// With MeshImpl::use_geometry_arena, meshes of the same layout share a vertex array and thus a batch (per material).
+// Note: shaders have to fetch their model matrices from the instance buffer (see examples/shader/draw_batched.vs),
+//       meshes without index buffer are drawn via the regular Drawelement path.
+// With an occlusion_culler set, each drawelement gets its own indirect command whose instance count is
+// written by the GPU visibility test against the culler's latest depth pyramid (usually built from the previous frame).
+
+class BatchRendererImpl {
+public:
+    BatchRendererImpl(const std::string& name);
+    virtual ~BatchRendererImpl();
+
+    // prevent copies and moves, since GL buffers aren't reference counted
+    BatchRendererImpl(const BatchRendererImpl&) = delete;
+    BatchRendererImpl& operator=(const BatchRendererImpl&) = delete;
+    BatchRendererImpl& operator=(const BatchRendererImpl&&) = delete;
+
+    // manage drawelements to render
+    void add(const Drawelement& elem);
+    void clear();
+
+    // upload instance data and draw all batches (model matrices are read from the drawelements on each call)
+    void draw();
+
+    // SSBO binding point of the instance buffer
+    static const uint32_t INSTANCE_BINDING = 0;
+
+    // data
+    const std::string name;
+    std::vector<Drawelement> drawelements;
+    StreamBuffer stream_buffer; // per-frame instance data and indirect commands
+    uint32_t num_batches; // multi-draw calls issued by the last draw()
+    uint32_t num_commands; // indirect commands submitted by the last draw()
+    OcclusionCuller occlusion_culler; // optional, see above
+
+private:
+    struct Batch {
+        const DrawelementImpl* elem; // first drawelement of the batch, used for binding shader and mesh
+        uint32_t first_command;
+        uint32_t num_commands;
+    };
+    std::vector<std::pair<const DrawelementImpl*, uint32_t>> sorted; // drawelement and selected level of detail
+    std::vector<InstanceData> instances;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<glm::vec4> bounds; // per command world space AABB (min, max), only with occlusion culling
+    std::vector<Batch> batches;
+};
+
+using BatchRenderer = NamedHandle<BatchRendererImpl>;
+
+CPPGL_NAMESPACE_END
@@ -3,20 +3,49 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include "named_handle.h"
+#include "deletion_queue.h"
+#include "gl_state.h"
 
 CPPGL_NAMESPACE_BEGIN
 
+// ----------------------------------------------------
+// helper funcs
+
+inline uint32_t type_to_bytes(GLenum type) {
+    switch (type) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+        return 2;
+    case GL_FLOAT:
+    case GL_FIXED:
+    case GL_INT:
+    case GL_UNSIGNED_INT:
+        return 4;
+    case GL_DOUBLE:
+        return 8;
+    default:
+        throw std::runtime_error("Unknown GL type!");
+    }
+}
+
 // ----------------------------------------------------
 // Generic GLBufferImpl
 
 template <GLenum GL_TEMPLATE_BUFFER> class GLBufferImpl {
 public:
-    GLBufferImpl(const std::string& name, size_t size_bytes = 0) : name(name) {
-        glGenBuffers(1, &id);
+    GLBufferImpl(const std::string& name, size_t size_bytes = 0) : name(name), size_bytes(0), immutable(false) {
+        if (GLState::dsa)
+            glCreateBuffers(1, &id);
+        else
+            glGenBuffers(1, &id);
         resize(size_bytes);
     }
     virtual ~GLBufferImpl() {
-        glDeleteBuffers(1, &id);
+        gl_delete_deferred(GLObject::BUFFER, id);
     }
 
     // prevent copies and moves, since GL buffers aren't reference counted
@@ -29,30 +58,52 @@ public:
 
     // bind/unbind to/from OpenGL
     void bind() const {
-        glBindBuffer(GL_TEMPLATE_BUFFER, id);
+        GLState::bind_buffer(GL_TEMPLATE_BUFFER, id);
     }
     void unbind() const {
-        glBindBuffer(GL_TEMPLATE_BUFFER, 0);
+        GLState::bind_buffer(GL_TEMPLATE_BUFFER, 0);
     }
     void bind_base(uint32_t unit) const {
-        glBindBufferBase(GL_TEMPLATE_BUFFER, unit, id);
+        GLState::bind_buffer_base(GL_TEMPLATE_BUFFER, unit, id);
     }
     void unbind_base(uint32_t unit) const {
-        glBindBufferBase(GL_TEMPLATE_BUFFER, unit, 0);
+        GLState::bind_buffer_base(GL_TEMPLATE_BUFFER, unit, 0);
     }
 
     // directly upload data (discards and reallocates memory, slow!)
     void upload_data(const void* data, size_t size_bytes, GLenum hint = GL_DYNAMIC_DRAW) {
-        bind();
+        if (immutable)
+            throw std::runtime_error("ERROR: GLBuffer: " + name + " has immutable storage and can't be reallocated!");
         this->size_bytes = size_bytes;
-        glBufferData(GL_TEMPLATE_BUFFER, size_bytes, data, hint);
-        unbind();
+        if (GLState::dsa)
+            glNamedBufferData(id, size_bytes, data, hint);
+        else {
+            bind();
+            glBufferData(GL_TEMPLATE_BUFFER, size_bytes, data, hint);
+            unbind();
+        }
     }
     // directly upload data (overwrites memory with no bounds checking, slow-ish)
     void upload_subdata(const void* data, size_t offset_bytes, size_t size_bytes) {
-        bind();
-        glBufferSubData(GL_TEMPLATE_BUFFER, offset_bytes, size_bytes, data);
-        unbind();
+        if (GLState::dsa)
+            glNamedBufferSubData(id, offset_bytes, size_bytes, data);
+        else {
+            bind();
+            glBufferSubData(GL_TEMPLATE_BUFFER, offset_bytes, size_bytes, data);
+            unbind();
+        }
+    }
+    // allocate immutable storage (size can't change afterwards, required for persistent mapping via map_range)
+    void storage(const void* data, size_t size_bytes, GLbitfield flags) {
+        this->size_bytes = size_bytes;
+        immutable = true;
+        if (GLState::dsa)
+            glNamedBufferStorage(id, size_bytes, data, flags);
+        else {
+            bind();
+            glBufferStorage(GL_TEMPLATE_BUFFER, size_bytes, data, flags);
+            unbind();
+        }
     }
     // resize (discards all data!)
     void resize(size_t size_bytes, GLenum hint = GL_DYNAMIC_DRAW) {
@@ -60,28 +111,45 @@ public:
     }
     // clear to 0x0
     void clear() {
-        bind();
         const GLuint zero = 0;
-        glClearBufferData(GL_TEMPLATE_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &zero);
-        unbind();
+        if (GLState::dsa)
+            glClearNamedBufferData(id, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &zero);
+        else {
+            bind();
+            glClearBufferData(GL_TEMPLATE_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &zero);
+            unbind();
+        }
     }
 
     // map/unmap from GPU mem for faster memory transfer
     // https://www.seas.upenn.edu/~pcozzi/OpenGLInsights/OpenGLInsights-AsynchronousBufferTransfers.pdf
     void* map(GLenum access = GL_READ_WRITE) const {
+        if (GLState::dsa)
+            return glMapNamedBuffer(id, access);
         bind();
         return glMapBuffer(GL_TEMPLATE_BUFFER, access);
     }
+    void* map_range(size_t offset_bytes, size_t size_bytes, GLbitfield access) const {
+        if (GLState::dsa)
+            return glMapNamedBufferRange(id, offset_bytes, size_bytes, access);
+        bind();
+        return glMapBufferRange(GL_TEMPLATE_BUFFER, offset_bytes, size_bytes, access);
+    }
     void unmap() const {
+        if (GLState::dsa) {
+            glUnmapNamedBuffer(id);
+            return;
+        }
+        bind(); // may have been unbound since map()
         glUnmapBuffer(GL_TEMPLATE_BUFFER);
         unbind();
     }
 
-
     // data
     const std::string name;
     GLuint id;
     size_t size_bytes;
+    bool immutable; // allocated via storage()
 };
 
 // ----------------------------------------------------
@@ -265,14 +265,14 @@ void CameraVisualization::display(const glm::mat4& view, const glm::mat4& proj){
     }
 
     bool culling = glIsEnabled(GL_CULL_FACE);
-    glDisable(GL_CULL_FACE);
+    GLState::disable(GL_CULL_FACE);
 
     if (lines){
         glPolygonMode(GL_FRONT_AND_BACK, lines ? GL_LINE : GL_FILL);      
         glLineWidth(line_width);  
     }
 
-    glUseProgram(gl_shader); 
+    GLState::use_program(gl_shader); 
     glUniformMatrix4fv(glGetUniformLocation(gl_shader, "inv_frustum_proj")
                         , 1, GL_FALSE, glm::value_ptr(glm::inverse(proj)));
     glUniformMatrix4fv(glGetUniformLocation(gl_shader, "inv_frustum_view")
@@ -285,15 +285,15 @@ void CameraVisualization::display(const glm::mat4& view, const glm::mat4& proj){
     glUniform3f(glGetUniformLocation(gl_shader, "uniform_color"), uniform_color.x, uniform_color.y, uniform_color.z);
 
 
-    glBindVertexArray(mesh->vao);
+    GLState::bind_vertex_array(mesh->vao);
     mesh->draw();
-    glBindVertexArray(0);
-    glUseProgram(0); 
+    GLState::bind_vertex_array(0);
+    GLState::use_program(0); 
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);   
 
     if(culling) 
-        glEnable(GL_CULL_FACE);
+        GLState::enable(GL_CULL_FACE);
 }
 
 // void CameraVisualization::display_view(const Texture2D& tex){
@@ -1,5 +1,6 @@
 #include "camera.h"
 #include "context.h"
+#include "frame_uniforms.h"
 #include "imgui/imgui.h"
 #include <iostream>
 #include <GL/glew.h>
@@ -22,6 +23,7 @@ Camera current_camera() {
 
 void make_camera_current(const Camera& cam) {
     current_cam = cam;
+    frame_uniforms_invalidate();
 }
 
 static glm::mat4 get_projection_matrix(float left, float right, float top, float bottom, float n, float f) {
@@ -52,6 +54,8 @@ CameraImpl::~CameraImpl() {}
 void CameraImpl::update() {
     update_view();
     update_proj();
+    if (!current_cam || current_cam.ptr.get() == this) // null: default camera
+        frame_uniforms_invalidate();
 }
 
 void CameraImpl::update_view() {
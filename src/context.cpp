@@ -14,6 +14,14 @@
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
 #include "image_load_store.h"
+#include "texture_streaming.h"
+#include "deletion_queue.h"
+#include "stream_buffer.h"
+#include "gl_state.h"
+#include "readback.h"
+#include "frame_capture.h"
+#include "shader_watcher.h"
+#include "frame_uniforms.h"
 #include <glm/glm.hpp>
 #include <iostream>
 
@@ -71,7 +79,7 @@ static void glfw_mouse_scroll_callback(GLFWwindow* window, double xoffset, doubl
 }
 
 static void glfw_resize_callback(GLFWwindow* window, int w, int h) {
-    glViewport(0, 0, w, h);
+    GLState::viewport(0, 0, w, h);
     if (user_resize_callback)
         user_resize_callback(w, h);
 }
@@ -124,6 +132,11 @@ Context::Context() {
     std::cout << "OpenGL: " << glGetString(GL_VERSION) << ", " << glGetString(GL_RENDERER) << std::endl;
     std::cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
+    // select buffer/texture backend
+    GLState::dsa = parameters.direct_state_access && (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access);
+    if (parameters.direct_state_access && !GLState::dsa)
+        std::cerr << "WARN: Context: direct state access not supported, falling back to bind-to-edit." << std::endl;
+
     // enable debugging output
     enable_strack_trace_on_crash();
     enable_gl_debug_output();
@@ -164,9 +177,9 @@ Context::Context() {
     ImGui::NewFrame();
 
     // set some sane GL defaults
-    glEnable(GL_DEPTH_TEST);
-    glCullFace(GL_BACK);
-    glEnable(GL_CULL_FACE);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::cull_face(GL_BACK);
+    GLState::enable(GL_CULL_FACE);
     glClearColor(0, 0, 0, 1);
     glClearDepth(1);
 
@@ -185,6 +198,11 @@ Context::Context() {
 }
 
 Context::~Context() {
+    frame_capture_stop();
+    shader_watcher_stop();
+    readback_flush();
+    texture_streaming_shutdown();
+    deletion_queue_flush();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -208,6 +226,7 @@ Context& Context::instance() {
 bool Context::running() { return !glfwWindowShouldClose(instance().glfw_window); }
 
 void Context::swap_buffers() {
+    frame_capture_update(); // before the GUI is drawn
     if (instance().show_gui) gui_draw();
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -216,6 +235,11 @@ void Context::swap_buffers() {
     instance().prim_count->end();
     instance().frag_count->end();
     glfwSwapBuffers(instance().glfw_window);
+    for (auto& [name, buffer] : StreamBuffer::map)
+        buffer->next_frame();
+    deletion_queue_update();
+    readback_update();
+    GLState::next_frame(); // also drops state changed by the GUI
     instance().frame_timer->end();
     instance().frame_timer->begin();
     instance().cpu_timer->begin();
@@ -225,6 +249,10 @@ void Context::swap_buffers() {
     instance().last_t = instance().curr_t;
     instance().curr_t = glfwGetTime() * 1000; // s to ms
     glfwPollEvents();
+    texture_streaming_update();
+    shader_watcher_update();
+    shader_compilation_update();
+    frame_uniforms_next_frame();
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -234,14 +262,10 @@ double Context::frame_time() { return instance().curr_t - instance().last_t; }
 
 void Context::screenshot(const std::filesystem::path& path) {
     const glm::ivec2 size = resolution();
-    std::vector<uint8_t> pixels(size_t(size.x) * size.y * 3);
-    // glReadPixels can align the first pixel in each row at 1-, 2-, 4- and 8-byte boundaries. We
-    // have allocated the exact size needed for the image so we have to use 1-byte alignment
-    // (otherwise glReadPixels would write out of bounds)
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadPixels(0, 0, size.x, size.y, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
-    // write ldr image to disk (async)
-    image_store_ldr(path, pixels.data(), size.x, size.y, 3, true, true);
+    // read into a pixel pack buffer without stalling, write ldr image to disk once the data arrived (async)
+    readback_framebuffer_async(0, 0, size.x, size.y, GL_RGB, GL_UNSIGNED_BYTE, [path, size](const std::vector<uint8_t>& pixels) {
+        image_store_ldr(path, pixels.data(), size.x, size.y, 3, true, true);
+    });
 }
 
 void Context::show() { glfwShowWindow(instance().glfw_window); }
@@ -256,7 +280,7 @@ glm::ivec2 Context::resolution() {
 
 void Context::resize(int w, int h) {
     glfwSetWindowSize(instance().glfw_window, w, h);
-    glViewport(0, 0, w, h);
+    GLState::viewport(0, 0, w, h);
 }
 
 void Context::set_title(const std::string& name) { glfwSetWindowTitle(instance().glfw_window, name.c_str()); }
@@ -25,6 +25,7 @@ struct ContextParameters {
     std::filesystem::path font_ttf_filename;
     uint32_t font_size_pixels = 13; // unused if no font is provided. use font scale instead
     float global_font_scale = 1.f;
+    bool direct_state_access = false; // DSA backend with immutable storage (see GLState), if supported
 };
 
 // Initialize and hold a GLFW/GL context + window.
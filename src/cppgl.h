@@ -3,23 +3,38 @@
 #include "platform.h"
 
 #include "anim.h"
+#include "batch_renderer.h"
 #include "buffer.h"
 #include "camera.h"
 #include "camera-visualizer.h"
 #include "context.h"
+#include "culling.h"
 #include "debug.h"
+#include "deletion_queue.h"
 #include "drawelement.h"
+#include "frame_capture.h"
+#include "frame_uniforms.h"
 #include "framebuffer.h"
 #include "geometry.h"
+#include "geometry_arena.h"
+#include "gl_state.h"
 #include "gui.h"
 #include "image_load_store.h"
 #include "material.h"
 #include "mesh.h"
+#include "mesh_cache.h"
 #include "named_handle.h"
 #include "quad.h"
 #include "query.h"
+#include "readback.h"
+#include "render_queue.h"
 #include "shader.h"
+#include "shader_watcher.h"
+#include "stream_buffer.h"
 #include "texture.h"
+#include "texture_streaming.h"
+#include "thread_pool.h"
+#include "vertex_format.h"
 
 #ifndef __CUDACC__
 //glm to string with <<operators
@@ -0,0 +1,223 @@
+#include "culling.h"
+#include <cmath>
+#include <algorithm>
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+CPPGL_NAMESPACE_BEGIN
+
+#ifdef __AVX__
+static const uint32_t SIMD_WIDTH = 8;
+#else
+static const uint32_t SIMD_WIDTH = 4;
+#endif
+static const float UNBOUNDED = 1e30f;
+
+// ------------------------------------------
+// helper funcs
+
+// per plane, the coordinates of the AABB corner furthest along the plane normal
+struct PlaneTest {
+    glm::vec4 plane;
+    const float *x, *y, *z;
+};
+
+static uint32_t test_block(const PlaneTest* tests, uint32_t i) {
+#if defined(__AVX__)
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+    for (uint32_t p = 0; p < 6; ++p) {
+        const PlaneTest& t = tests[p];
+        __m256 d = _mm256_set1_ps(t.plane.w);
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(t.plane.x), _mm256_loadu_ps(t.x + i)));
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(t.plane.y), _mm256_loadu_ps(t.y + i)));
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(t.plane.z), _mm256_loadu_ps(t.z + i)));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+    }
+    return uint32_t(_mm256_movemask_ps(inside));
+#elif defined(__SSE__)
+    const __m128 zero = _mm_setzero_ps();
+    __m128 inside = _mm_cmpeq_ps(zero, zero);
+    for (uint32_t p = 0; p < 6; ++p) {
+        const PlaneTest& t = tests[p];
+        __m128 d = _mm_set1_ps(t.plane.w);
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(t.plane.x), _mm_loadu_ps(t.x + i)));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(t.plane.y), _mm_loadu_ps(t.y + i)));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(t.plane.z), _mm_loadu_ps(t.z + i)));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+    }
+    return uint32_t(_mm_movemask_ps(inside));
+#else
+    uint32_t mask = 0;
+    for (uint32_t j = 0; j < SIMD_WIDTH; ++j) {
+        bool inside = true;
+        for (uint32_t p = 0; p < 6 && inside; ++p) {
+            const PlaneTest& t = tests[p];
+            inside = t.plane.x * t.x[i + j] + t.plane.y * t.y[i + j] + t.plane.z * t.z[i + j] + t.plane.w >= 0.f;
+        }
+        mask |= uint32_t(inside) << j;
+    }
+    return mask;
+#endif
+}
+
+// ------------------------------------------
+// Frustum
+
+Frustum::Frustum(const glm::mat4& view_proj) {
+    // Gribb/Hartmann plane extraction from the rows of the clip space transform
+    const glm::mat4 m = glm::transpose(view_proj);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+    for (auto& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::intersects(const glm::vec3& bb_min, const glm::vec3& bb_max) const {
+    for (const auto& plane : planes) {
+        const glm::vec3 p = glm::vec3(plane.x >= 0.f ? bb_max.x : bb_min.x, plane.y >= 0.f ? bb_max.y : bb_min.y, plane.z >= 0.f ? bb_max.z : bb_min.z);
+        if (glm::dot(glm::vec3(plane), p) + plane.w < 0.f)
+            return false;
+    }
+    return true;
+}
+
+// ------------------------------------------
+// FrustumCuller
+
+FrustumCullerImpl::FrustumCullerImpl(const std::string& name)
+    : name(name), auto_update_bounds(true), visible_count(CounterQuery(name + "/visible")) {}
+
+FrustumCullerImpl::~FrustumCullerImpl() {}
+
+void FrustumCullerImpl::add(const Drawelement& elem) {
+    drawelements.push_back(elem);
+}
+
+void FrustumCullerImpl::clear() {
+    drawelements.clear();
+    visible.clear();
+    visible_indices.clear();
+}
+
+void FrustumCullerImpl::update_bounds() {
+    const size_t padded = (drawelements.size() + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    // padding is an inverted (empty) box and thus always culled
+    min_x.assign(padded, UNBOUNDED); min_y.assign(padded, UNBOUNDED); min_z.assign(padded, UNBOUNDED);
+    max_x.assign(padded, -UNBOUNDED); max_y.assign(padded, -UNBOUNDED); max_z.assign(padded, -UNBOUNDED);
+    for (size_t i = 0; i < drawelements.size(); ++i) {
+        const Drawelement& elem = drawelements[i];
+        glm::vec3 lower(-UNBOUNDED), upper(UNBOUNDED); // never cull drawelements without mesh
+        if (elem->mesh)
+            transform_bounds(elem->model, elem->mesh->bb_min, elem->mesh->bb_max, lower, upper);
+        min_x[i] = lower.x; min_y[i] = lower.y; min_z[i] = lower.z;
+        max_x[i] = upper.x; max_y[i] = upper.y; max_z[i] = upper.z;
+    }
+}
+
+uint32_t FrustumCullerImpl::cull(const Camera& cam) {
+    if (auto_update_bounds || min_x.size() < drawelements.size())
+        update_bounds();
+    const Frustum frustum(cam->proj * cam->view);
+    PlaneTest tests[6];
+    for (uint32_t p = 0; p < 6; ++p) {
+        const glm::vec4& plane = frustum.planes[p];
+        tests[p] = PlaneTest{ plane, plane.x >= 0.f ? max_x.data() : min_x.data(),
+            plane.y >= 0.f ? max_y.data() : min_y.data(), plane.z >= 0.f ? max_z.data() : min_z.data() };
+    }
+
+    visible.clear();
+    visible_indices.clear();
+    visible_count->begin();
+    const uint32_t N = uint32_t(drawelements.size());
+    for (uint32_t i = 0; i < N; i += SIMD_WIDTH) {
+        const uint32_t mask = test_block(tests, i);
+        if (!mask) continue;
+        for (uint32_t j = 0; j < SIMD_WIDTH && i + j < N; ++j) {
+            if (mask & (1u << j)) {
+                visible_indices.push_back(i + j);
+                visible.push_back(drawelements[i + j]);
+            }
+        }
+    }
+    visible_count->add(uint32_t(visible.size()));
+    visible_count->end();
+    return uint32_t(visible.size());
+}
+
+// ------------------------------------------
+// OcclusionCuller
+
+static Shader find_or_create_compute_shader(const std::string& name, const fs::path& source) {
+    if (Shader::valid(name))
+        return Shader::find(name);
+    return Shader(name, source);
+}
+
+OcclusionCullerImpl::OcclusionCullerImpl(const std::string& name)
+    : name(name), view_proj(1), bounds_buffer(StreamBuffer(name + "/bounds", 256 * 1024)), visibility_buffer(SSBO(name + "/visibility")) {
+    // shipped with cppgl, found via ShaderImpl::shader_search_paths
+    downsample_shader = find_or_create_compute_shader("cppgl/hiz_downsample", "hiz_downsample.glcs");
+    cull_shader = find_or_create_compute_shader("cppgl/hiz_cull", "hiz_cull.glcs");
+}
+
+OcclusionCullerImpl::~OcclusionCullerImpl() {}
+
+void OcclusionCullerImpl::build_pyramid(const Texture2D& depth, const Camera& cam) {
+    // (re-)create pyramid on resolution changes
+    if (!pyramid || pyramid->w != depth->w || pyramid->h != depth->h) {
+        Texture2D::erase(name + "/pyramid");
+        pyramid = Texture2D(name + "/pyramid", depth->w, depth->h, GL_R32F, GL_RED, GL_FLOAT, nullptr, true);
+    }
+    view_proj = cam->proj * cam->view;
+
+    // level 0 copies the depth buffer, each further level reduces the previous one
+    const uint32_t levels = 1 + uint32_t(std::floor(std::log2(float(std::max(depth->w, depth->h)))));
+    downsample_shader->bind();
+    for (uint32_t level = 0; level < levels; ++level) {
+        const uint32_t w = std::max(1u, uint32_t(depth->w) >> level), h = std::max(1u, uint32_t(depth->h) >> level);
+        downsample_shader->uniform("src", level == 0 ? depth : pyramid, 0);
+        downsample_shader->uniform("src_level", int(level == 0 ? 0 : level - 1));
+        pyramid->bind_image(0, GL_WRITE_ONLY, GL_R32F, level);
+        downsample_shader->dispatch_compute(w, h, 1, GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    pyramid->unbind_image(0);
+    pyramid->unbind();
+    downsample_shader->unbind();
+}
+
+void OcclusionCullerImpl::cull(const std::vector<glm::vec4>& bounds, const StreamAllocation& commands) {
+    const uint32_t num_objects = uint32_t(bounds.size() / 2);
+    if (num_objects == 0) return;
+    if (!pyramid) {
+        const std::vector<uint32_t> visible(num_objects, 1);
+        visibility_buffer->upload_data(visible.data(), visible.size() * sizeof(uint32_t), GL_STREAM_DRAW);
+        return;
+    }
+    const StreamAllocation bounds_alloc = bounds_buffer->upload(bounds);
+    if (visibility_buffer->size_bytes < num_objects * sizeof(uint32_t))
+        visibility_buffer->resize(num_objects * sizeof(uint32_t));
+
+    cull_shader->bind();
+    bounds_alloc.bind_range(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING);
+    visibility_buffer->bind_base(VISIBILITY_BINDING);
+    if (commands.buffer)
+        commands.bind_range(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING);
+    cull_shader->uniform("hiz", pyramid, 0);
+    cull_shader->uniform("view_proj", view_proj);
+    cull_shader->uniform("num_objects", num_objects);
+    cull_shader->uniform("write_commands", int(commands.buffer != 0));
+    cull_shader->dispatch_compute(num_objects, 1, 1, GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    GLState::bind_buffer_base(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, 0);
+    visibility_buffer->unbind_base(VISIBILITY_BINDING);
+    GLState::bind_buffer_base(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING, 0);
+    pyramid->unbind();
+    cull_shader->unbind();
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "named_handle.h"
+#include "drawelement.h"
+#include "camera.h"
+#include "query.h"
+#include "buffer.h"
+#include "shader.h"
+#include "texture.h"
+#include "stream_buffer.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// helper funcs
+
+// world space AABB of a transformed object space AABB
+inline void transform_bounds(const glm::mat4& model, const glm::vec3& bb_min, const glm::vec3& bb_max, glm::vec3& lower, glm::vec3& upper) {
+    const glm::vec3 center = glm::vec3(model * glm::vec4((bb_min + bb_max) * 0.5f, 1.f));
+    const glm::vec3 extent = (bb_max - bb_min) * 0.5f;
+    const glm::vec3 world_extent = glm::abs(glm::vec3(model[0])) * extent.x + glm::abs(glm::vec3(model[1])) * extent.y + glm::abs(glm::vec3(model[2])) * extent.z;
+    lower = center - world_extent;
+    upper = center + world_extent;
+}
+
+// ------------------------------------------
+// View frustum (normalized planes, dot(plane, vec4(p, 1)) >= 0 for points inside)
+
+struct Frustum {
+    Frustum(const glm::mat4& view_proj);
+
+    // conservative test of a world space AABB
+    bool intersects(const glm::vec3& bb_min, const glm::vec3& bb_max) const;
+
+    // data
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+};
+
+// ------------------------------------------
+// FrustumCuller
+// Keeps world space AABBs of its drawelements in SoA layout and tests them against the camera frustum
+// in SIMD batches (AVX or SSE, depending on the target), visible drawelements are gathered for drawing.
+// The number of visible drawelements per cull() is tracked in the CounterQuery "<name>/visible".
+
+class FrustumCullerImpl {
+public:
+    FrustumCullerImpl(const std::string& name);
+    virtual ~FrustumCullerImpl();
+
+    // manage drawelements to cull
+    void add(const Drawelement& elem);
+    void clear();
+
+    // recompute world space bounds from model matrices and mesh bounds
+    void update_bounds();
+    // cull against the frustum of given camera, gathers visible drawelements and returns their count
+    uint32_t cull(const Camera& cam = current_camera());
+
+    // data
+    const std::string name;
+    bool auto_update_bounds; // call update_bounds() on each cull (default: true), disable for static scenes
+    std::vector<Drawelement> drawelements;
+    std::vector<Drawelement> visible; // result of the last cull()
+    std::vector<uint32_t> visible_indices; // indices into drawelements of the last cull()
+    CounterQuery visible_count;
+    // world space AABBs, padded to a multiple of the SIMD width
+    std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+};
+
+using FrustumCuller = NamedHandle<FrustumCullerImpl>;
+
+// ------------------------------------------
+// OcclusionCuller (GPU hierarchical-Z)
+// Builds a max-depth pyramid from a depth buffer and tests world space AABBs against it in a compute shader.
+// Results are meant for the next frame: objects are tested against the pyramid and camera of the previous build,
+// so newly disoccluded objects may appear one frame late. See BatchRendererImpl::occlusion_culler for use with indirect draws.
+
+class OcclusionCullerImpl {
+public:
+    OcclusionCullerImpl(const std::string& name);
+    virtual ~OcclusionCullerImpl();
+
+    // prevent copies and moves, since GL buffers aren't reference counted
+    OcclusionCullerImpl(const OcclusionCullerImpl&) = delete;
+    OcclusionCullerImpl& operator=(const OcclusionCullerImpl&) = delete;
+    OcclusionCullerImpl& operator=(const OcclusionCullerImpl&&) = delete;
+
+    // build depth pyramid from given depth texture (call after rendering a frame with the camera it was rendered with)
+    void build_pyramid(const Texture2D& depth, const Camera& cam = current_camera());
+
+    // test AABBs (pairs of world space min/max) against the pyramid, writes one uint per AABB into visibility_buffer
+    // and, if given, into the instance counts of commands (one DrawElementsIndirectCommand per AABB)
+    // everything is visible until the first pyramid is built
+    void cull(const std::vector<glm::vec4>& bounds, const StreamAllocation& commands = StreamAllocation());
+
+    // SSBO binding points used by the cull shader
+    static const uint32_t BOUNDS_BINDING = 0;
+    static const uint32_t VISIBILITY_BINDING = 1;
+    static const uint32_t COMMAND_BINDING = 2;
+
+    // data
+    const std::string name;
+    Texture2D pyramid; // R32F with full mip chain
+    glm::mat4 view_proj; // camera transform of the last build_pyramid()
+    StreamBuffer bounds_buffer;
+    SSBO visibility_buffer;
+    Shader downsample_shader, cull_shader;
+};
+
+using OcclusionCuller = NamedHandle<OcclusionCullerImpl>;
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,133 @@
+#include "deletion_queue.h"
+#include "gl_state.h"
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// state
+
+struct Retired {
+    GLsync fence = 0;
+    std::vector<std::pair<GLObject, GLuint>> objects;
+    std::vector<std::function<void()>> callbacks;
+};
+
+struct DeletionQueue {
+    std::mutex mutex;
+    Retired pending; // guarded by mutex
+    std::deque<Retired> in_flight; // context thread only
+    std::atomic<size_t> num_in_flight{0};
+};
+
+// never destroyed, since handles may still be released during static destruction
+static DeletionQueue& queue() {
+    static DeletionQueue* q = new DeletionQueue;
+    return *q;
+}
+
+// ------------------------------------------
+// helper funcs
+
+static void delete_objects(GLObject type, const std::vector<GLuint>& ids) {
+    const GLsizei n = GLsizei(ids.size());
+    for (GLuint id : ids)
+        GLState::forget(type, id); // names may be reused right away
+    switch (type) {
+        case GLObject::BUFFER: glDeleteBuffers(n, ids.data()); break;
+        case GLObject::TEXTURE: glDeleteTextures(n, ids.data()); break;
+        case GLObject::VERTEX_ARRAY: glDeleteVertexArrays(n, ids.data()); break;
+        case GLObject::FRAMEBUFFER: glDeleteFramebuffers(n, ids.data()); break;
+        case GLObject::QUERY: glDeleteQueries(n, ids.data()); break;
+        case GLObject::PROGRAM:
+            for (GLuint id : ids)
+                glDeleteProgram(id);
+            break;
+    }
+}
+
+static void release(Retired& retired) {
+    // batch deletions per object type
+    std::sort(retired.objects.begin(), retired.objects.end());
+    std::vector<GLuint> ids;
+    for (size_t i = 0; i < retired.objects.size(); ++i) {
+        ids.push_back(retired.objects[i].second);
+        if (i + 1 == retired.objects.size() || retired.objects[i + 1].first != retired.objects[i].first) {
+            delete_objects(retired.objects[i].first, ids);
+            ids.clear();
+        }
+    }
+    for (auto& fn : retired.callbacks)
+        fn();
+    if (retired.fence)
+        glDeleteSync(retired.fence);
+}
+
+// ------------------------------------------
+// deletion queue
+
+void gl_delete_deferred(GLObject type, GLuint id) {
+    if (id == 0) return;
+    DeletionQueue& q = queue();
+    const std::lock_guard<std::mutex> lock(q.mutex);
+    q.pending.objects.emplace_back(type, id);
+}
+
+void gl_defer(std::function<void()> fn) {
+    DeletionQueue& q = queue();
+    const std::lock_guard<std::mutex> lock(q.mutex);
+    q.pending.callbacks.push_back(std::move(fn));
+}
+
+void deletion_queue_update() {
+    DeletionQueue& q = queue();
+    Retired retired;
+    {
+        const std::lock_guard<std::mutex> lock(q.mutex);
+        std::swap(retired, q.pending);
+    }
+    if (!retired.objects.empty() || !retired.callbacks.empty()) {
+        retired.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        q.num_in_flight += retired.objects.size() + retired.callbacks.size();
+        q.in_flight.push_back(std::move(retired));
+    }
+    // fences are signaled in order, so stop at the first one still pending
+    while (!q.in_flight.empty()) {
+        const GLenum status = glClientWaitSync(q.in_flight.front().fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) break;
+        q.num_in_flight -= q.in_flight.front().objects.size() + q.in_flight.front().callbacks.size();
+        release(q.in_flight.front());
+        q.in_flight.pop_front();
+    }
+}
+
+void deletion_queue_flush() {
+    DeletionQueue& q = queue();
+    // callbacks may release further objects, so repeat until empty
+    while (deletion_queue_pending() > 0) {
+        Retired retired;
+        {
+            const std::lock_guard<std::mutex> lock(q.mutex);
+            std::swap(retired, q.pending);
+        }
+        while (!q.in_flight.empty()) {
+            release(q.in_flight.front());
+            q.in_flight.pop_front();
+        }
+        q.num_in_flight = 0;
+        release(retired);
+    }
+}
+
+size_t deletion_queue_pending() {
+    DeletionQueue& q = queue();
+    const std::lock_guard<std::mutex> lock(q.mutex);
+    return q.pending.objects.size() + q.pending.callbacks.size() + q.num_in_flight;
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Deferred deletion of GL objects
+// Objects can be released from any thread. Pending releases are fenced with glFenceSync on the next update
+// (context thread, once per frame via Context::swap_buffers) and deleted in batches once the GPU has passed that fence.
+// This decouples resource lifetime from the context thread, e.g. handles can safely be dropped by worker threads.
+
+enum class GLObject { BUFFER, TEXTURE, VERTEX_ARRAY, FRAMEBUFFER, PROGRAM, QUERY };
+
+// release GL object (thread safe, id 0 is ignored)
+void gl_delete_deferred(GLObject type, GLuint id);
+// run fn on the context thread once the GPU has finished all work submitted so far (thread safe)
+void gl_defer(std::function<void()> fn);
+
+// fence pending releases and delete those whose fence has passed (called once per frame by Context::swap_buffers)
+void deletion_queue_update();
+// delete everything right away, regardless of GPU progress (e.g. before the context is destroyed)
+void deletion_queue_flush();
+
+// amount of objects and callbacks not yet released
+size_t deletion_queue_pending();
+
+CPPGL_NAMESPACE_END
@@ -1,9 +1,12 @@
 #include "drawelement.h"
 #include "camera.h"
+#include "frame_uniforms.h"
 #include <iostream>
 
 CPPGL_NAMESPACE_BEGIN
 
+float DrawelementImpl::lod_threshold = 0.001f; // about one pixel at 1080p
+
 DrawelementImpl::DrawelementImpl(const std::string& name, const Shader& shader, const Mesh& mesh)
     : name(name), model(glm::mat4(1)), shader(shader), mesh(mesh) {}
 
@@ -13,11 +16,16 @@ void DrawelementImpl::bind() const {
     if (shader) {
         shader->bind();
         if (mesh) mesh->bind(shader);
-        shader->uniform("model", model);
+        shader->uniform("model", mesh ? model * mesh->position_decode : model);
         shader->uniform("model_normal", glm::transpose(glm::inverse(model)));
-        shader->uniform("view", current_camera()->view);
-        shader->uniform("view_normal", current_camera()->view_normal);
-        shader->uniform("proj", current_camera()->proj);
+        if (shader->frame_uniforms_block)
+            frame_uniforms_bind();
+        else {
+            const Camera cam = current_camera();
+            shader->uniform("view", cam->view);
+            shader->uniform("view_normal", cam->view_normal);
+            shader->uniform("proj", cam->proj);
+        }
     }
 }
 
@@ -27,8 +35,8 @@ void DrawelementImpl::unbind() const {
 }
 
 void DrawelementImpl::draw() const {
-    if (mesh)
-        mesh->draw();
+    if (mesh && (!shader || shader->ready())) // skip while the first program is still compiling
+        mesh->draw(mesh->select_lod(model, current_camera(), lod_threshold));
 }
 
 CPPGL_NAMESPACE_END
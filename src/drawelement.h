@@ -15,9 +15,12 @@ public:
     virtual ~DrawelementImpl();
 
     void bind() const;
-    void draw() const;
+    void draw() const; // with level of detail selected for the current camera
     void unbind() const;
 
+    // max. projected LOD error as fraction of the viewport height (negative: always draw full detail)
+    static float lod_threshold;
+
     // data
     const std::string name;
     glm::mat4 model;
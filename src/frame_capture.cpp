@@ -0,0 +1,194 @@
+#include "frame_capture.h"
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include "buffer.h"
+#include "context.h"
+#include "thread_pool.h"
+#include "image_load_store.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// state
+
+enum SlotState : uint32_t { SLOT_FREE, SLOT_READBACK, SLOT_ENCODING };
+
+struct CaptureSlot {
+    PPBO pbo;
+    const uint8_t* ptr = 0; // persistently mapped, read only
+    GLsync fence = 0;
+    int w = 0, h = 0;
+    uint64_t frame = 0;
+    std::atomic<uint32_t> state{SLOT_FREE}; // written by encoder threads
+};
+
+struct FrameCapture {
+    FrameCaptureParameters params;
+    std::vector<std::unique_ptr<CaptureSlot>> slots;
+    std::deque<CaptureSlot*> in_flight; // in fence order
+    std::unique_ptr<ThreadPool> encoders;
+    uint64_t next_frame = 0;
+    uint64_t captured = 0, dropped = 0;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint32_t> queued{0};
+};
+
+static std::unique_ptr<FrameCapture> capture;
+static FrameCaptureStats last_stats;
+
+// ------------------------------------------
+// helper funcs
+
+static const GLbitfield STORAGE_FLAGS = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// (re-)allocate slot storage if too small for the given size
+static void reserve(CaptureSlot& slot, size_t index, size_t size_bytes) {
+    if (slot.pbo && slot.pbo->size_bytes >= size_bytes) return;
+    const std::string name = "frame_capture_buffer_" + std::to_string(index);
+    if (slot.pbo) {
+        slot.pbo->unmap();
+        PPBO::erase(name);
+    }
+    slot.pbo = PPBO(name);
+    slot.pbo->storage(0, size_bytes, STORAGE_FLAGS);
+    slot.ptr = (const uint8_t*)slot.pbo->map_range(0, size_bytes, STORAGE_FLAGS);
+    slot.pbo->unbind();
+    if (!slot.ptr)
+        throw std::runtime_error("ERROR: FrameCapture: failed to map buffer storage!");
+}
+
+static fs::path frame_path(const FrameCaptureParameters& params, uint64_t frame) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "_%06llu", (unsigned long long)frame);
+    return params.directory / (params.prefix + number + params.extension);
+}
+
+// hand readbacks whose fence has passed to the encoders (in order, optionally waiting for them)
+static void dispatch(bool block) {
+    FrameCapture& c = *capture;
+    while (!c.in_flight.empty()) {
+        CaptureSlot* slot = c.in_flight.front();
+        GLenum status = glClientWaitSync(slot->fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, 0);
+        while (block && status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+        if (status == GL_TIMEOUT_EXPIRED) break;
+        glDeleteSync(slot->fence);
+        slot->fence = 0;
+        c.in_flight.pop_front();
+        slot->state = SLOT_ENCODING;
+        c.queued++;
+        const fs::path path = frame_path(c.params, slot->frame);
+        FrameCapture* cp = &c;
+        c.encoders->enqueue([cp, slot, path]() {
+            try {
+                image_store_ldr(path, slot->ptr, slot->w, slot->h, 3, true, false);
+                cp->written++;
+            } catch (std::exception& e) {
+                std::cerr << "WARN: FrameCapture: " << e.what() << std::endl;
+            }
+            cp->queued--;
+            slot->state = SLOT_FREE;
+        });
+    }
+}
+
+static CaptureSlot* find_free_slot(size_t& index) {
+    for (index = 0; index < capture->slots.size(); ++index)
+        if (capture->slots[index]->state == SLOT_FREE)
+            return capture->slots[index].get();
+    return 0;
+}
+
+// ------------------------------------------
+// Frame capture
+
+void frame_capture_start(const FrameCaptureParameters& params) {
+    if (capture) frame_capture_stop();
+    const std::string ext = params.extension;
+    if (ext != ".png" && ext != ".jpg" && ext != ".jpeg" && ext != ".tga" && ext != ".bmp")
+        throw std::runtime_error("ERROR: FrameCapture: unsupported image format: " + ext);
+    if (!GLEW_ARB_buffer_storage)
+        throw std::runtime_error("ERROR: FrameCapture: ARB_buffer_storage not supported!");
+    fs::create_directories(params.directory);
+    capture = std::make_unique<FrameCapture>();
+    capture->params = params;
+    for (uint32_t i = 0; i < std::max(1u, params.num_buffers); ++i)
+        capture->slots.push_back(std::make_unique<CaptureSlot>());
+    capture->encoders = std::make_unique<ThreadPool>(std::max(1u, params.num_encoders));
+    last_stats = FrameCaptureStats();
+}
+
+void frame_capture_stop() {
+    if (!capture) return;
+    dispatch(true);
+    capture->encoders.reset(); // finishes all queued frames
+    last_stats = frame_capture_stats();
+    for (auto& slot : capture->slots) {
+        if (!slot->pbo) continue;
+        slot->pbo->unmap();
+        PPBO::erase(slot->pbo->name);
+    }
+    capture.reset();
+}
+
+bool frame_capture_active() {
+    return bool(capture);
+}
+
+void frame_capture_update() {
+    if (!capture) return;
+    FrameCapture& c = *capture;
+    dispatch(false);
+
+    // find a free buffer or apply backpressure
+    size_t index = 0;
+    CaptureSlot* slot = find_free_slot(index);
+    if (!slot && c.params.drop_frames) {
+        c.dropped++;
+        return;
+    }
+    while (!slot) {
+        dispatch(true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        slot = find_free_slot(index);
+    }
+
+    // read back buffer of the default framebuffer into the slot
+    const glm::ivec2 size = Context::resolution();
+    reserve(*slot, index, size_t(size.x) * size.y * 3);
+    slot->w = size.x;
+    slot->h = size.y;
+    slot->frame = c.next_frame++;
+    GLint prev_fbo = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_fbo);
+    GLState::bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    slot->pbo->bind();
+    glReadPixels(0, 0, size.x, size.y, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    slot->pbo->unbind();
+    GLState::bind_framebuffer(GL_READ_FRAMEBUFFER, prev_fbo);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->state = SLOT_READBACK;
+    c.in_flight.push_back(slot);
+    c.captured++;
+}
+
+FrameCaptureStats frame_capture_stats() {
+    if (!capture) return last_stats;
+    FrameCaptureStats stats;
+    stats.captured = capture->captured;
+    stats.written = capture->written;
+    stats.dropped = capture->dropped;
+    stats.in_flight = uint32_t(capture->in_flight.size());
+    stats.queued = capture->queued;
+    return stats;
+}
+
+CPPGL_NAMESPACE_END
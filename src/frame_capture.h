@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <filesystem>
+namespace fs = std::filesystem;
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Frame capture (image sequences, e.g. for video output)
+// While active, each frame's back buffer (without GUI) is read into a ring of persistently mapped pixel pack buffers.
+// Once its fence has passed, a bounded pool of encoder threads writes the frame directly from the mapped buffer,
+// which is then returned to the ring. If all buffers are busy, the frame is dropped (or rendering stalls, see drop_frames).
+// Written frames are numbered consecutively in capture order: <directory>/<prefix>_000000<extension>, ...
+// Note: all functions have to be called from the context thread, frame_capture_update() is called by Context::swap_buffers.
+
+struct FrameCaptureParameters {
+    fs::path directory = "capture";
+    std::string prefix = "frame";
+    std::string extension = ".jpg"; // see image_store_ldr, .jpg and .tga encode considerably faster than .png
+    uint32_t num_buffers = 8; // ring size, bounds the frames waiting for the GPU or being encoded
+    uint32_t num_encoders = 6;
+    bool drop_frames = true; // drop frames while the ring is full, else stall rendering until a buffer is free
+};
+
+struct FrameCaptureStats {
+    uint64_t captured = 0; // frames read back
+    uint64_t written = 0; // frames encoded and written to disk
+    uint64_t dropped = 0; // frames skipped since all buffers were busy
+    uint32_t in_flight = 0; // frames waiting for the GPU
+    uint32_t queued = 0; // frames waiting for or being encoded
+};
+
+// start capturing with given parameters (restarts a running capture)
+void frame_capture_start(const FrameCaptureParameters& params = FrameCaptureParameters());
+// stop capturing, blocks until all captured frames are written
+void frame_capture_stop();
+bool frame_capture_active();
+
+// encode finished readbacks and grab the current back buffer (called once per frame by Context::swap_buffers)
+void frame_capture_update();
+
+// stats of the running (or last) capture
+FrameCaptureStats frame_capture_stats();
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,70 @@
+#include "frame_uniforms.h"
+#include <cstddef>
+#include "buffer.h"
+#include "camera.h"
+#include "context.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// state
+
+static UBO ubo;
+static FrameUniforms data;
+static bool dirty = true;
+static uint32_t frame_counter = 0;
+
+// ------------------------------------------
+// Frame uniforms
+
+std::vector<std::pair<std::string, size_t>> frame_uniforms_layout() {
+#define MEMBER(x) { #x, offsetof(FrameUniforms, x) }
+    return { MEMBER(view), MEMBER(view_normal), MEMBER(proj), MEMBER(view_proj), MEMBER(inv_view), MEMBER(inv_proj),
+        MEMBER(camera_pos), MEMBER(camera_dir), MEMBER(resolution), MEMBER(time), MEMBER(delta_time), MEMBER(frame),
+        MEMBER(camera_near), MEMBER(camera_far), MEMBER(camera_fov) };
+#undef MEMBER
+}
+
+void frame_uniforms_bind() {
+    if (!dirty) {
+        // data is current, but the binding point may have been reused since the upload
+        ubo->bind_base(FRAME_UNIFORMS_BINDING);
+        return;
+    }
+    const Camera cam = current_camera();
+    data.view = cam->view;
+    data.view_normal = cam->view_normal;
+    data.proj = cam->proj;
+    data.view_proj = cam->proj * cam->view;
+    data.inv_view = glm::inverse(cam->view);
+    data.inv_proj = glm::inverse(cam->proj);
+    data.camera_pos = glm::vec4(cam->pos, 1);
+    data.camera_dir = glm::vec4(cam->dir, 0);
+    data.resolution = glm::vec2(Context::resolution());
+    data.time = float(Context::instance().curr_t / 1000.0);
+    data.delta_time = float(Context::frame_time() / 1000.0);
+    data.frame = frame_counter;
+    data.camera_near = cam->near;
+    data.camera_far = cam->far;
+    data.camera_fov = cam->fov_degree;
+    if (!ubo)
+        ubo = UBO("cppgl/frame_uniforms", sizeof(FrameUniforms));
+    ubo->upload_subdata(&data, 0, sizeof(FrameUniforms));
+    ubo->bind_base(FRAME_UNIFORMS_BINDING);
+    dirty = false;
+}
+
+void frame_uniforms_invalidate() {
+    dirty = true;
+}
+
+void frame_uniforms_next_frame() {
+    frame_counter++;
+    dirty = true;
+}
+
+const FrameUniforms& frame_uniforms() {
+    return data;
+}
+
+CPPGL_NAMESPACE_END
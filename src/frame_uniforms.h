@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Per-frame uniform block (std140, see shader/frame_uniforms.glsl)
+// Camera, time and resolution data is written into a single UBO at most once per frame and camera change,
+// instead of per draw. Shaders declaring the block (via #include "frame_uniforms.glsl") get it bound to
+// FRAME_UNIFORMS_BINDING on link, where the layout is validated against this struct via reflection.
+// Note: the data is written lazily by frame_uniforms_bind() (called by DrawelementImpl::bind and BatchRenderer),
+// so camera updates before the first draw of a frame are picked up.
+
+static const uint32_t FRAME_UNIFORMS_BINDING = 0;
+
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 view_normal;
+    glm::mat4 proj;
+    glm::mat4 view_proj;
+    glm::mat4 inv_view;
+    glm::mat4 inv_proj;
+    glm::vec4 camera_pos;
+    glm::vec4 camera_dir;
+    glm::vec2 resolution;
+    float time;
+    float delta_time;
+    uint32_t frame;
+    float camera_near;
+    float camera_far;
+    float camera_fov;
+};
+static_assert(sizeof(FrameUniforms) == 448, "FrameUniforms has to match the std140 layout of shader/frame_uniforms.glsl!");
+
+// member offsets for layout validation (name -> offset in bytes)
+std::vector<std::pair<std::string, size_t>> frame_uniforms_layout();
+
+// upload the data of the current camera if outdated, then (re)bind the block
+void frame_uniforms_bind();
+// mark data as outdated (called on camera updates and switches)
+void frame_uniforms_invalidate();
+// advance frame counter and time (called once per frame by Context::swap_buffers)
+void frame_uniforms_next_frame();
+
+// data of the last upload
+const FrameUniforms& frame_uniforms();
+
+CPPGL_NAMESPACE_END
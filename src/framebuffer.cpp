@@ -1,32 +1,67 @@
 #include "framebuffer.h"
+#include "deletion_queue.h"
+#include "gl_state.h"
 #include <atomic>
 
 CPPGL_NAMESPACE_BEGIN
 
+// ------------------------------------------
+// helper funcs
+
+static void attach_texture(GLuint fbo, GLenum attachment, GLuint tex) {
+    if (GLState::dsa)
+        glNamedFramebufferTexture(fbo, attachment, tex, 0);
+    else {
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, tex, 0);
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
+    }
+}
+
+// draw buffers are framebuffer state, so they are set on attachment instead of on each bind
+static void set_draw_buffers(GLuint fbo, const std::vector<GLenum>& targets) {
+    if (GLState::dsa)
+        glNamedFramebufferDrawBuffers(fbo, GLsizei(targets.size()), targets.data());
+    else {
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, fbo);
+        glDrawBuffers(GLsizei(targets.size()), targets.data());
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
+    }
+}
+
+static inline GLenum depth_attachment(const Texture2D& tex) {
+    return tex->format == GL_DEPTH_STENCIL ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+}
+
+// ------------------------------------------
+// FramebufferImpl
+
 FramebufferImpl::FramebufferImpl(const std::string& name, uint32_t w, uint32_t h) : name(name), id(0), w(w), h(h), prev_vp{0,0,0,0} {
-    glGenFramebuffers(1, &id);
+    if (GLState::dsa)
+        glCreateFramebuffers(1, &id);
+    else
+        glGenFramebuffers(1, &id);
 }
 
 FramebufferImpl::~FramebufferImpl() {
-    glDeleteFramebuffers(1, &id);
+    gl_delete_deferred(GLObject::FRAMEBUFFER, id);
 }
 
 void FramebufferImpl::bind() {
-    glGetIntegerv(GL_VIEWPORT, prev_vp);
-    glViewport(0, 0, w, h);
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
-    glDrawBuffers(GLsizei(color_targets.size()), color_targets.data());
+    GLState::get_viewport(prev_vp);
+    GLState::viewport(0, 0, w, h);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, id);
 }
 
 void FramebufferImpl::unbind() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(prev_vp[0], prev_vp[1], prev_vp[2], prev_vp[3]);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
+    GLState::viewport(prev_vp[0], prev_vp[1], prev_vp[2], prev_vp[3]);
 }
 
 void FramebufferImpl::check() const {
     if (!(depth_texture && *depth_texture))
         throw std::runtime_error("ERROR: Framebuffer: depth buffer not present or invalid!");
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, id);
     const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (status != GL_FRAMEBUFFER_COMPLETE) {
         std::string s;
@@ -40,7 +75,7 @@ void FramebufferImpl::check() const {
             s = "GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER";
         throw std::runtime_error("ERROR: Framebuffer incomplete! Status: " + s);
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void FramebufferImpl::resize(uint32_t w, uint32_t h) {
@@ -50,6 +85,13 @@ void FramebufferImpl::resize(uint32_t w, uint32_t h) {
         depth_texture->resize(w, h);
     for (auto& tex : color_textures)
         tex->resize(w, h);
+    if (GLState::dsa) {
+        // resizing recreated the texture objects, so reattach them
+        if (depth_texture)
+            attach_texture(id, depth_attachment(depth_texture), depth_texture->id);
+        for (uint32_t i = 0; i < color_textures.size(); ++i)
+            attach_texture(id, color_targets[i], color_textures[i]->id);
+    }
 }
 
 void FramebufferImpl::attach_depthbuffer(Texture2D tex, bool with_stencil) {
@@ -61,19 +103,17 @@ void FramebufferImpl::attach_depthbuffer(Texture2D tex, bool with_stencil) {
                                 with_stencil ? GL_DEPTH_STENCIL                  : GL_DEPTH_COMPONENT,
                                 with_stencil ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_FLOAT);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
     depth_texture = tex;
-    glFramebufferTexture2D(GL_FRAMEBUFFER, with_stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex->id, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    attach_texture(id, with_stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, tex->id);
+    set_draw_buffers(id, color_targets);
 }
 
 void FramebufferImpl::attach_colorbuffer(const Texture2D& tex) {
     const GLenum target = GL_COLOR_ATTACHMENT0 + GLenum(color_targets.size());
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, target, GL_TEXTURE_2D, tex->id, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    attach_texture(id, target, tex->id);
     color_textures.push_back(tex);
     color_targets.push_back(target);
+    set_draw_buffers(id, color_targets);
 }
 
 CPPGL_NAMESPACE_END
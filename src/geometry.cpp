@@ -1,10 +1,16 @@
 #include <geometry.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <array>
+#include <cmath>
+#include <map>
 
 CPPGL_NAMESPACE_BEGIN
 
-GeometryImpl::GeometryImpl(const std::string& name) : name(name), bb_min(FLT_MAX), bb_max(FLT_MIN) {}
+GeometryImpl::GeometryImpl(const std::string& name) : name(name), bb_min(FLT_MAX), bb_max(-FLT_MAX) {}
 
 GeometryImpl::GeometryImpl(const std::string& name, const aiMesh* mesh_ai) : GeometryImpl(name) {
     add(mesh_ai);
@@ -20,22 +26,29 @@ GeometryImpl::~GeometryImpl() {}
 void GeometryImpl::add(const aiMesh* mesh_ai) {
     // conversion helper
     const auto to_glm = [](const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); };
-    // extract vertices, normals and texture coords
-    positions.reserve(positions.size() + mesh_ai->mNumVertices);
-    normals.reserve(normals.size() + mesh_ai->HasNormals() ? mesh_ai->mNumVertices : 0);
-    texcoords.reserve(texcoords.size() + mesh_ai->HasTextureCoords(0) ? mesh_ai->mNumVertices : 0);
-    for (uint32_t i = 0; i < mesh_ai->mNumVertices; ++i) {
-        positions.emplace_back(to_glm(mesh_ai->mVertices[i]));
-        if (mesh_ai->HasNormals())
-            normals.emplace_back(to_glm(mesh_ai->mNormals[i]));
-        if (mesh_ai->HasTextureCoords(0))
-            texcoords.emplace_back(glm::vec2(to_glm(mesh_ai->mTextureCoords[0][i])));
+    // extract vertices, normals and texture coords (resize once, then write in place)
+    const size_t n = mesh_ai->mNumVertices;
+    const size_t pos_offset = positions.size(), norm_offset = normals.size(), tc_offset = texcoords.size();
+    positions.resize(pos_offset + n);
+    for (size_t i = 0; i < n; ++i) {
+        positions[pos_offset + i] = to_glm(mesh_ai->mVertices[i]);
         // update AABB
-        bb_min = glm::min(bb_min, to_glm(mesh_ai->mVertices[i]));
-        bb_max = glm::max(bb_max, to_glm(mesh_ai->mVertices[i]));
+        bb_min = glm::min(bb_min, positions[pos_offset + i]);
+        bb_max = glm::max(bb_max, positions[pos_offset + i]);
+    }
+    if (mesh_ai->HasNormals()) {
+        normals.resize(norm_offset + n);
+        for (size_t i = 0; i < n; ++i)
+            normals[norm_offset + i] = to_glm(mesh_ai->mNormals[i]);
+    }
+    if (mesh_ai->HasTextureCoords(0)) {
+        texcoords.resize(tc_offset + n);
+        for (size_t i = 0; i < n; ++i)
+            texcoords[tc_offset + i] = glm::vec2(mesh_ai->mTextureCoords[0][i].x, mesh_ai->mTextureCoords[0][i].y);
     }
     // extract faces
     indices.reserve(indices.size() + mesh_ai->mNumFaces*3);
+    uint32_t skipped = 0;
     for (uint32_t i = 0; i < mesh_ai->mNumFaces; ++i) {
         const aiFace &face = mesh_ai->mFaces[i];
         if (face.mNumIndices == 3) {
@@ -43,8 +56,10 @@ void GeometryImpl::add(const aiMesh* mesh_ai) {
             indices.emplace_back(face.mIndices[1]);
             indices.emplace_back(face.mIndices[2]);
         } else
-            std::cerr << "WARN: Geometry: skipping non-triangle face!" << std::endl;
+            skipped++;
     }
+    if (skipped)
+        std::cerr << "WARN: Geometry: skipping " << skipped << " non-triangle face(s) in " << name << "!" << std::endl;
 }
 
 void GeometryImpl::add(const GeometryImpl& other) {
@@ -74,16 +89,18 @@ void GeometryImpl::add(const std::vector<glm::vec3>& positions, const std::vecto
 }
 
 void GeometryImpl::clear() {
-    bb_min = bb_max = glm::vec3(0);
+    bb_min = glm::vec3(FLT_MAX);
+    bb_max = glm::vec3(-FLT_MAX);
     positions.clear();
     indices.clear();
     normals.clear();
     texcoords.clear();
+    lods.clear();
 }
 
 void GeometryImpl::recompute_aabb() {
     bb_min = glm::vec3(FLT_MAX);
-    bb_max = glm::vec3(FLT_MIN);;
+    bb_max = glm::vec3(-FLT_MAX);
     for (const auto& pos : positions) {
         bb_min = glm::min(bb_min, pos);
         bb_max = glm::max(bb_max, pos);
@@ -98,17 +115,20 @@ void GeometryImpl::fit_into_aabb(const glm::vec3& aabb_min, const glm::vec3& aab
     // apply
     for (uint32_t i = 0; i < positions.size(); ++i)
         positions[i] = (positions[i] - center) * scale_f;
+    recompute_aabb();
 }
 
 void GeometryImpl::translate(const glm::vec3& by) {
     for (uint32_t i = 0; i < positions.size(); ++i)
         positions[i] += by;
+    recompute_aabb();
 }
 
 void GeometryImpl::scale(const glm::vec3& by) {
     // scale positions
     for (uint32_t i = 0; i < positions.size(); ++i)
         positions[i] *= by;
+    recompute_aabb(); // negative factors flip min and max
     // scale normals
     const glm::mat4 mat_norm = glm::transpose(glm::inverse(glm::scale(glm::mat4(1), by)));
     for (uint32_t i = 0; i < normals.size(); ++i)
@@ -120,10 +140,491 @@ void GeometryImpl::rotate(float angle_degrees, const glm::vec3& axis) {
     const glm::mat4 rot = glm::rotate(glm::mat4(1), glm::radians(angle_degrees), axis);
     for (uint32_t i = 0; i < positions.size(); ++i)
         positions[i] = glm::vec3(rot * glm::vec4(positions[i], 1));
+    recompute_aabb();
     // rotate normals
     const glm::mat4 rot_inv_tra = glm::transpose(glm::inverse(rot));
     for (uint32_t i = 0; i < normals.size(); ++i)
         normals[i] = glm::normalize(glm::vec3(rot_inv_tra * glm::vec4(normals[i], 0)));
 }
 
+// ------------------------------------------
+// mesh optimization helper funcs
+
+// FIFO post-transform cache simulation via insertion timestamps (a vertex is cached if less than cache_size insertions happened since its own)
+struct FifoCache {
+    FifoCache(size_t num_vertices, uint32_t cache_size) : cache_size(cache_size), time(cache_size + 1), stamps(num_vertices, 0) {}
+    inline uint32_t access(uint32_t v) {
+        if (time - stamps[v] < cache_size) return 0;
+        stamps[v] = time++;
+        return 1;
+    }
+    inline void flush() { time += cache_size + 1; }
+    const uint32_t cache_size;
+    uint32_t time;
+    std::vector<uint32_t> stamps;
+};
+
+static inline float forsyth_vertex_score(int32_t cache_pos, uint32_t remaining, uint32_t cache_size) {
+    if (remaining == 0) return -1.f; // no triangles left to emit
+    float score = 0.f;
+    if (cache_pos >= 0) // recently used vertices of the last triangle get a fixed score to avoid strips
+        score = cache_pos < 3 ? 0.75f : std::pow(1.f - float(cache_pos - 3) / float(cache_size - 3), 1.5f);
+    return score + 2.f / std::sqrt(float(remaining)); // prefer vertices with few triangles left
+}
+
+// ------------------------------------------
+// mesh optimization
+
+void GeometryImpl::weld_vertices(float epsilon) {
+    struct Key {
+        std::array<uint32_t, 8> bits;
+        inline bool operator==(const Key& other) const { return bits == other.bits; }
+    };
+    struct KeyHash {
+        inline size_t operator()(const Key& key) const {
+            uint64_t h = 14695981039346656037ull; // FNV-1a
+            for (const uint32_t b : key.bits)
+                h = (h ^ b) * 1099511628211ull;
+            return size_t(h);
+        }
+    };
+    const size_t num_vertices = positions.size();
+    const bool has_n = has_normals(), has_t = has_texcoords();
+    const float inv_epsilon = epsilon > 0.f ? 1.f / epsilon : 0.f;
+    const auto make_key = [&](size_t i) {
+        const glm::vec3 n = has_n ? normals[i] : glm::vec3(0);
+        const glm::vec2 t = has_t ? texcoords[i] : glm::vec2(0);
+        const float values[8] = { positions[i].x, positions[i].y, positions[i].z, n.x, n.y, n.z, t.x, t.y };
+        Key key;
+        for (int j = 0; j < 8; ++j) {
+            float f = inv_epsilon > 0.f ? std::round(values[j] * inv_epsilon) : values[j];
+            if (f == 0.f) f = 0.f; // -0 == +0
+            std::memcpy(&key.bits[j], &f, sizeof(float));
+        }
+        return key;
+    };
+    // find unique vertices
+    std::unordered_map<Key, uint32_t, KeyHash> unique;
+    unique.reserve(num_vertices);
+    std::vector<uint32_t> remap(num_vertices);
+    std::vector<glm::vec3> new_positions, new_normals;
+    std::vector<glm::vec2> new_texcoords;
+    for (size_t i = 0; i < num_vertices; ++i) {
+        const auto [it, inserted] = unique.emplace(make_key(i), uint32_t(new_positions.size()));
+        if (inserted) {
+            new_positions.push_back(positions[i]);
+            if (has_n) new_normals.push_back(normals[i]);
+            if (has_t) new_texcoords.push_back(texcoords[i]);
+        }
+        remap[i] = it->second;
+    }
+    for (auto& index : indices)
+        index = remap[index];
+    for (auto& lod : lods)
+        for (auto& index : lod.indices)
+            index = remap[index];
+    positions.swap(new_positions);
+    normals.swap(new_normals);
+    texcoords.swap(new_texcoords);
+}
+
+static void forsyth_order(std::vector<uint32_t>& indices, size_t num_vertices, uint32_t cache_size) {
+    const size_t num_triangles = indices.size() / 3;
+    if (num_triangles == 0) return;
+    cache_size = std::max(cache_size, 4u);
+    // vertex -> triangle adjacency (first remaining[v] entries are the not yet emitted triangles)
+    std::vector<uint32_t> remaining(num_vertices, 0), offsets(num_vertices + 1, 0);
+    for (size_t i = 0; i < num_triangles * 3; ++i)
+        remaining[indices[i]]++;
+    for (size_t v = 0; v < num_vertices; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<uint32_t> adjacency(offsets[num_vertices]), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < num_triangles; ++t)
+        for (int k = 0; k < 3; ++k)
+            adjacency[fill[indices[3 * t + k]]++] = uint32_t(t);
+    // initial scores
+    std::vector<int32_t> cache_pos(num_vertices, -1);
+    std::vector<float> vertex_score(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v)
+        vertex_score[v] = forsyth_vertex_score(-1, remaining[v], cache_size);
+    int64_t best = -1;
+    float best_score = -1.f;
+    for (size_t t = 0; t < num_triangles; ++t) {
+        const float score = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] + vertex_score[indices[3 * t + 2]];
+        if (score > best_score) {
+            best = int64_t(t);
+            best_score = score;
+        }
+    }
+    // greedily emit the best scored triangle adjacent to the cache
+    std::vector<uint8_t> emitted(num_triangles, 0);
+    std::vector<uint32_t> cache, new_cache, result;
+    result.reserve(num_triangles * 3);
+    size_t cursor = 0;
+    while (result.size() < num_triangles * 3) {
+        if (best < 0) { // no cached vertex has triangles left, continue with next unemitted triangle
+            while (emitted[cursor]) ++cursor;
+            best = int64_t(cursor);
+        }
+        const size_t t = size_t(best);
+        emitted[t] = 1;
+        new_cache.clear();
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t v = indices[3 * t + k];
+            result.push_back(v);
+            // remove triangle from active adjacency
+            uint32_t* begin = adjacency.data() + offsets[v];
+            uint32_t* end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, uint32_t(t)), end - 1);
+            remaining[v]--;
+            if (std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end())
+                new_cache.push_back(v);
+        }
+        const size_t num_triangle_vertices = new_cache.size();
+        for (const uint32_t v : cache)
+            if (std::find(new_cache.begin(), new_cache.begin() + num_triangle_vertices, v) == new_cache.begin() + num_triangle_vertices)
+                new_cache.push_back(v);
+        // update cache positions and vertex scores
+        for (size_t i = cache_size; i < new_cache.size(); ++i) {
+            cache_pos[new_cache[i]] = -1;
+            vertex_score[new_cache[i]] = forsyth_vertex_score(-1, remaining[new_cache[i]], cache_size);
+        }
+        cache.assign(new_cache.begin(), new_cache.begin() + std::min<size_t>(cache_size, new_cache.size()));
+        for (size_t i = 0; i < cache.size(); ++i) {
+            cache_pos[cache[i]] = int32_t(i);
+            vertex_score[cache[i]] = forsyth_vertex_score(int32_t(i), remaining[cache[i]], cache_size);
+        }
+        // find best triangle adjacent to cache
+        best = -1;
+        best_score = -1.f;
+        for (const uint32_t v : cache) {
+            for (uint32_t j = 0; j < remaining[v]; ++j) {
+                const uint32_t tt = adjacency[offsets[v] + j];
+                const float score = vertex_score[indices[3 * tt]] + vertex_score[indices[3 * tt + 1]] + vertex_score[indices[3 * tt + 2]];
+                if (score > best_score) {
+                    best = tt;
+                    best_score = score;
+                }
+            }
+        }
+    }
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void GeometryImpl::optimize_vertex_cache(uint32_t cache_size) {
+    forsyth_order(indices, positions.size(), cache_size);
+    for (auto& lod : lods)
+        forsyth_order(lod.indices, positions.size(), cache_size);
+}
+
+void GeometryImpl::optimize_overdraw(float threshold, uint32_t cache_size) {
+    const size_t num_triangles = indices.size() / 3;
+    if (num_triangles < 2) return;
+    // cache misses per triangle in current order, hard cluster boundaries are where the cache effectively restarts
+    std::vector<uint32_t> hard_clusters;
+    {
+        FifoCache cache(positions.size(), cache_size);
+        for (size_t t = 0; t < num_triangles; ++t) {
+            const uint32_t misses = cache.access(indices[3 * t]) + cache.access(indices[3 * t + 1]) + cache.access(indices[3 * t + 2]);
+            if (t == 0 || misses == 3)
+                hard_clusters.push_back(uint32_t(t));
+        }
+        hard_clusters.push_back(uint32_t(num_triangles));
+    }
+    // split further into soft clusters, as long as the ACMR stays within threshold of the hard cluster's
+    std::vector<uint32_t> clusters;
+    FifoCache cache(positions.size(), cache_size);
+    for (size_t c = 0; c + 1 < hard_clusters.size(); ++c) {
+        const uint32_t begin = hard_clusters[c], end = hard_clusters[c + 1];
+        uint32_t cluster_misses = 0;
+        cache.flush();
+        for (uint32_t t = begin; t < end; ++t)
+            cluster_misses += cache.access(indices[3 * t]) + cache.access(indices[3 * t + 1]) + cache.access(indices[3 * t + 2]);
+        const float limit = threshold * float(cluster_misses) / float(end - begin);
+        clusters.push_back(begin);
+        cache.flush();
+        uint32_t start = begin, misses = 0;
+        for (uint32_t t = begin; t < end; ++t) {
+            misses += cache.access(indices[3 * t]) + cache.access(indices[3 * t + 1]) + cache.access(indices[3 * t + 2]);
+            if (t + 1 < end && float(misses) / float(t + 1 - start) <= limit) {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+    clusters.push_back(uint32_t(num_triangles));
+    // area weighted centroid and normal per cluster
+    const size_t num_clusters = clusters.size() - 1;
+    std::vector<glm::vec3> centroids(num_clusters, glm::vec3(0)), cluster_normals(num_clusters, glm::vec3(0));
+    std::vector<float> areas(num_clusters, 0.f);
+    glm::vec3 mesh_centroid(0);
+    float mesh_area = 0.f;
+    for (size_t c = 0; c < num_clusters; ++c) {
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const glm::vec3& a = positions[indices[3 * t]], & b = positions[indices[3 * t + 1]], & d = positions[indices[3 * t + 2]];
+            const glm::vec3 n = glm::cross(b - a, d - a);
+            const float area = glm::length(n);
+            centroids[c] += (a + b + d) * (area / 3.f);
+            cluster_normals[c] += n;
+            areas[c] += area;
+        }
+        mesh_centroid += centroids[c];
+        mesh_area += areas[c];
+        if (areas[c] > 0.f) centroids[c] /= areas[c];
+    }
+    if (mesh_area > 0.f) mesh_centroid /= mesh_area;
+    // sort clusters outside-in: facing away from the center first, as they likely occlude the rest
+    std::vector<float> sort_keys(num_clusters);
+    for (size_t c = 0; c < num_clusters; ++c) {
+        const float len = glm::length(cluster_normals[c]);
+        sort_keys[c] = len > 0.f ? glm::dot(centroids[c] - mesh_centroid, cluster_normals[c] / len) : 0.f;
+    }
+    std::vector<uint32_t> order(num_clusters);
+    for (size_t c = 0; c < num_clusters; ++c)
+        order[c] = uint32_t(c);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (const uint32_t c : order)
+        result.insert(result.end(), indices.begin() + 3 * size_t(clusters[c]), indices.begin() + 3 * size_t(clusters[c + 1]));
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void GeometryImpl::optimize_vertex_fetch() {
+    const size_t num_vertices = positions.size();
+    const bool has_n = has_normals(), has_t = has_texcoords();
+    // assign new vertex ids in order of first use
+    std::vector<uint32_t> remap(num_vertices, uint32_t(-1));
+    uint32_t next = 0;
+    for (auto& index : indices) {
+        if (remap[index] == uint32_t(-1))
+            remap[index] = next++;
+        index = remap[index];
+    }
+    for (auto& lod : lods) // subset of the full detail vertices
+        for (auto& index : lod.indices)
+            index = remap[index];
+    std::vector<glm::vec3> new_positions(next), new_normals(has_n ? next : 0);
+    std::vector<glm::vec2> new_texcoords(has_t ? next : 0);
+    for (size_t v = 0; v < num_vertices; ++v) {
+        if (remap[v] == uint32_t(-1)) continue;
+        new_positions[remap[v]] = positions[v];
+        if (has_n) new_normals[remap[v]] = normals[v];
+        if (has_t) new_texcoords[remap[v]] = texcoords[v];
+    }
+    positions.swap(new_positions);
+    normals.swap(new_normals);
+    texcoords.swap(new_texcoords);
+    if (next < num_vertices)
+        recompute_aabb();
+}
+
+void GeometryImpl::optimize() {
+    weld_vertices();
+    optimize_vertex_cache();
+    optimize_overdraw();
+    optimize_vertex_fetch();
+}
+
+float GeometryImpl::acmr(uint32_t cache_size) const {
+    const size_t num_triangles = indices.size() / 3;
+    if (num_triangles == 0) return 0.f;
+    FifoCache cache(positions.size(), cache_size);
+    size_t misses = 0;
+    for (size_t i = 0; i < num_triangles * 3; ++i)
+        misses += cache.access(indices[i]);
+    return float(misses) / float(num_triangles);
+}
+
+// ------------------------------------------
+// level of detail helper funcs
+
+// error quadric (symmetric 4x4 matrix) with accumulated weight, evaluates to the weighted mean squared plane distance
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0, w = 0;
+
+    static Quadric from_plane(const glm::vec3& n, float d, float weight) {
+        Quadric q;
+        q.a2 = weight * n.x * n.x; q.ab = weight * n.x * n.y; q.ac = weight * n.x * n.z; q.ad = weight * n.x * d;
+        q.b2 = weight * n.y * n.y; q.bc = weight * n.y * n.z; q.bd = weight * n.y * d;
+        q.c2 = weight * n.z * n.z; q.cd = weight * n.z * d;
+        q.d2 = weight * d * d;
+        q.w = weight;
+        return q;
+    }
+    inline void add(const Quadric& q) {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2; w += q.w;
+    }
+    inline double eval(const glm::vec3& p) const {
+        const double x = p.x, y = p.y, z = p.z;
+        const double e = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x + b2*y*y + 2*bc*y*z + 2*bd*y + c2*z*z + 2*cd*z + d2;
+        return w > 0 ? std::abs(e) / w : 0.0;
+    }
+};
+
+static inline uint64_t edge_key(uint32_t a, uint32_t b) {
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+// ------------------------------------------
+// level of detail
+
+std::vector<uint32_t> GeometryImpl::simplify(const std::vector<uint32_t>& source_indices, size_t target_index_count, float max_error, float* result_error) const {
+    const size_t num_vertices = positions.size();
+    std::vector<uint32_t> result(source_indices.begin(), source_indices.begin() + source_indices.size() / 3 * 3);
+    float error = 0.f;
+    if (result.size() <= target_index_count || num_vertices == 0) {
+        if (result_error) *result_error = error;
+        return result;
+    }
+    const double max_cost = double(max_error) * double(max_error);
+
+    // lock attribute seams: vertices sharing their position with another vertex must stay, else cracks appear
+    std::vector<uint8_t> locked(num_vertices, 0);
+    {
+        std::map<std::array<float, 3>, uint32_t> first;
+        for (const uint32_t v : result) {
+            const auto [it, inserted] = first.emplace(std::array<float, 3>{ positions[v].x, positions[v].y, positions[v].z }, v);
+            if (!inserted && it->second != v)
+                locked[v] = locked[it->second] = 1;
+        }
+    }
+    // border edges (used by exactly one triangle)
+    std::unordered_map<uint64_t, uint32_t> edge_count;
+    for (size_t i = 0; i < result.size(); i += 3)
+        for (int k = 0; k < 3; ++k)
+            edge_count[edge_key(result[i + k], result[i + (k + 1) % 3])]++;
+    std::vector<uint8_t> border(num_vertices, 0);
+    // quadrics: area weighted triangle planes plus perpendicular planes along borders
+    std::vector<Quadric> quadrics(num_vertices);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const glm::vec3& p0 = positions[result[i]], & p1 = positions[result[i + 1]], & p2 = positions[result[i + 2]];
+        const glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+        const float area = glm::length(cross) * 0.5f;
+        if (area <= 0.f) continue;
+        const glm::vec3 n = cross / (2.f * area);
+        const Quadric q = Quadric::from_plane(n, -glm::dot(n, p0), area);
+        for (int k = 0; k < 3; ++k) {
+            quadrics[result[i + k]].add(q);
+            const uint32_t a = result[i + k], b = result[i + (k + 1) % 3];
+            if (edge_count[edge_key(a, b)] != 1) continue;
+            border[a] = border[b] = 1;
+            const glm::vec3 edge = positions[b] - positions[a];
+            const float len = glm::length(edge);
+            if (len <= 0.f) continue;
+            const glm::vec3 bn = glm::normalize(glm::cross(edge, n));
+            const Quadric bq = Quadric::from_plane(bn, -glm::dot(bn, positions[a]), 10.f * len * len);
+            quadrics[a].add(bq);
+            quadrics[b].add(bq);
+        }
+    }
+
+    // collapse in passes: sort candidates by cost, collapse independent ones, rebuild triangles
+    struct Collapse {
+        uint32_t from, to;
+        double cost;
+    };
+    std::vector<uint32_t> offsets(num_vertices + 1), adjacency, remap(num_vertices);
+    std::vector<uint8_t> touched(num_vertices);
+    std::vector<Collapse> candidates;
+    while (result.size() > target_index_count) {
+        const size_t num_triangles = result.size() / 3;
+        // vertex -> triangle adjacency
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (const uint32_t v : result) offsets[v + 1]++;
+        for (size_t v = 0; v < num_vertices; ++v) offsets[v + 1] += offsets[v];
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < num_triangles; ++t)
+            for (int k = 0; k < 3; ++k)
+                adjacency[fill[result[3 * t + k]]++] = uint32_t(t);
+        // candidates (half edge collapses from -> to, borders only collapse along the border)
+        candidates.clear();
+        for (size_t t = 0; t < num_triangles; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t a = result[3 * t + k], b = result[3 * t + (k + 1) % 3];
+                const bool border_edge = edge_count[edge_key(a, b)] == 1;
+                for (const auto& [from, to] : { std::make_pair(a, b), std::make_pair(b, a) }) {
+                    if (locked[from] || from == to || (border[from] && !border_edge)) continue;
+                    Quadric q = quadrics[from];
+                    q.add(quadrics[to]);
+                    candidates.push_back(Collapse{ from, to, q.eval(positions[to]) });
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+        // collapse independent candidates
+        for (size_t v = 0; v < num_vertices; ++v) remap[v] = uint32_t(v);
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t remaining = num_triangles, collapses = 0;
+        const size_t target_triangles = target_index_count / 3;
+        for (const auto& c : candidates) {
+            if (c.cost > max_cost || remaining <= target_triangles) break;
+            if (touched[c.from] || touched[c.to]) continue;
+            // reject collapses that flip (or nearly degenerate) triangles around from
+            bool valid = true;
+            size_t removed = 0;
+            for (uint32_t j = offsets[c.from]; j < offsets[c.from + 1] && valid; ++j) {
+                const uint32_t* tri = &result[3 * adjacency[j]];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                    removed++;
+                    continue;
+                }
+                glm::vec3 p[3] = { positions[tri[0]], positions[tri[1]], positions[tri[2]] };
+                const glm::vec3 n_before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                for (int k = 0; k < 3; ++k)
+                    if (tri[k] == c.from) p[k] = positions[c.to];
+                const glm::vec3 n_after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                valid = glm::dot(n_before, n_after) > 0.25f * glm::length(n_before) * glm::length(n_after);
+            }
+            if (!valid || removed == 0) continue;
+            // collapse and lock the one-ring for this pass
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            for (uint32_t j = offsets[c.from]; j < offsets[c.from + 1]; ++j)
+                for (int k = 0; k < 3; ++k)
+                    touched[result[3 * adjacency[j] + k]] = 1;
+            error = std::max(error, float(std::sqrt(c.cost)));
+            remaining -= removed;
+            collapses++;
+        }
+        if (collapses == 0) break;
+        // rebuild triangles, drop degenerates
+        size_t write = 0;
+        for (size_t t = 0; t < num_triangles; ++t) {
+            const uint32_t a = remap[result[3 * t]], b = remap[result[3 * t + 1]], c = remap[result[3 * t + 2]];
+            if (a == b || b == c || a == c) continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+        // recount edges for the next pass
+        edge_count.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+            for (int k = 0; k < 3; ++k)
+                edge_count[edge_key(result[i + k], result[i + (k + 1) % 3])]++;
+    }
+    if (result_error) *result_error = error;
+    return result;
+}
+
+void GeometryImpl::generate_lods(uint32_t max_levels, float ratio, float max_error) {
+    lods.clear();
+    const std::vector<uint32_t>* source = &indices;
+    float error = 0.f;
+    for (uint32_t level = 0; level < max_levels; ++level) {
+        const size_t target = size_t(float(source->size() / 3) * ratio) * 3;
+        float level_error = 0.f;
+        std::vector<uint32_t> lod_indices = simplify(*source, target, max_error, &level_error);
+        if (lod_indices.empty() || lod_indices.size() > source->size() * 0.9f) break; // no (significant) progress
+        forsyth_order(lod_indices, positions.size(), 32);
+        error += level_error; // errors are relative to the previous level
+        lods.push_back(GeometryLod{ std::move(lod_indices), error });
+        source = &lods.back().indices;
+    }
+}
+
 CPPGL_NAMESPACE_END
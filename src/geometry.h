@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <cfloat>
 #include <glm/glm.hpp>
 #include "platform.h"
 #include <assimp/mesh.h>
@@ -8,6 +9,14 @@
 
 CPPGL_NAMESPACE_BEGIN
 
+// ------------------------------------------
+// Geometry level of detail (index-only, shares the vertex data of the full detail geometry)
+
+struct GeometryLod {
+    std::vector<uint32_t> indices;
+    float error; // approx. max. object space deviation from the full detail surface
+};
+
 // ------------------------------------------
 // Geometry
 
@@ -30,13 +39,25 @@ public:
     inline bool has_normals() const { return !normals.empty(); }
     inline bool has_texcoords() const { return !texcoords.empty(); }
 
-    // O(n) geometry operations
+    // O(n) geometry operations (bb_min/bb_max are kept up to date, recompute_aabb() is only needed after editing positions directly)
     void recompute_aabb();
     void fit_into_aabb(const glm::vec3& aabb_min, const glm::vec3& aabb_max);
     void translate(const glm::vec3& by);
     void scale(const glm::vec3& by);
     void rotate(float angle_degrees, const glm::vec3& axis);
 
+    // mesh optimization (triangle lists only, attributes are kept in sync)
+    void weld_vertices(float epsilon = 0.f); // merge vertices with equal attributes (within epsilon if > 0)
+    void optimize_vertex_cache(uint32_t cache_size = 32); // reorder triangles for post-transform cache hits (Forsyth)
+    void optimize_overdraw(float threshold = 1.05f, uint32_t cache_size = 32); // sort triangle clusters outside-in, allowed ACMR increase: threshold (Tipsify style)
+    void optimize_vertex_fetch(); // reorder vertices by first use, drops unreferenced vertices
+    void optimize(); // all of the above, in order
+    float acmr(uint32_t cache_size = 32) const; // average cache miss ratio (transformed vertices per triangle) for a FIFO cache
+
+    // level of detail (quadric error metric edge collapses onto existing vertices, borders and attribute seams are kept)
+    std::vector<uint32_t> simplify(const std::vector<uint32_t>& source_indices, size_t target_index_count, float max_error = FLT_MAX, float* result_error = 0) const;
+    void generate_lods(uint32_t max_levels = 4, float ratio = 0.5f, float max_error = FLT_MAX); // replaces lods, stops early without progress
+
     // data
     const std::string name;
     glm::vec3 bb_min, bb_max;
@@ -44,6 +65,7 @@ public:
     std::vector<uint32_t> indices;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec2> texcoords;
+    std::vector<GeometryLod> lods; // coarser levels, lods[i] has about ratio^(i+1) of the full triangle count
 };
 
 using Geometry = NamedHandle<GeometryImpl>;
@@ -0,0 +1,192 @@
+#include "geometry_arena.h"
+#include "deletion_queue.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <stdexcept>
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// helper funcs
+
+// pools have a fixed size until they grow, so use immutable storage with the DSA backend
+template <typename BufferT> static BufferT create_buffer(const std::string& name, size_t size_bytes) {
+    if (!GLState::dsa || size_bytes == 0)
+        return BufferT(name, size_bytes);
+    BufferT buffer(name);
+    buffer->storage(0, size_bytes, GL_DYNAMIC_STORAGE_BIT | GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+    return buffer;
+}
+
+template <typename BufferT> static BufferT grow_buffer(const BufferT& old, size_t size_bytes) {
+    const std::string name = old->name;
+    BufferT::erase(name); // avoid duplicate name warning, old buffer is kept alive by the handle
+    BufferT grown = create_buffer<BufferT>(name, size_bytes);
+    if (GLState::dsa)
+        glCopyNamedBufferSubData(old->id, grown->id, 0, 0, old->size_bytes);
+    else {
+        GLState::bind_buffer(GL_COPY_READ_BUFFER, old->id);
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, grown->id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old->size_bytes);
+        GLState::bind_buffer(GL_COPY_READ_BUFFER, 0);
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    return grown;
+}
+
+// ------------------------------------------
+// FreeListAllocator
+
+FreeListAllocator::FreeListAllocator(uint32_t capacity) : capacity(0), used(0) {
+    grow(capacity);
+}
+
+bool FreeListAllocator::allocate(uint32_t size, uint32_t& offset) {
+    for (auto it = free_blocks.begin(); it != free_blocks.end(); ++it) {
+        if (it->second < size) continue;
+        offset = it->first;
+        const uint32_t remaining = it->second - size;
+        free_blocks.erase(it);
+        if (remaining > 0)
+            free_blocks[offset + size] = remaining;
+        used += size;
+        return true;
+    }
+    return false;
+}
+
+void FreeListAllocator::free(uint32_t offset, uint32_t size) {
+    if (size == 0) return;
+    used -= size;
+    auto it = free_blocks.emplace(offset, size).first;
+    // merge with successor
+    auto next = std::next(it);
+    if (next != free_blocks.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        free_blocks.erase(next);
+    }
+    // merge with predecessor
+    if (it != free_blocks.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            free_blocks.erase(it);
+        }
+    }
+}
+
+void FreeListAllocator::grow(uint32_t new_capacity) {
+    if (new_capacity <= capacity) return;
+    const uint32_t old_capacity = capacity;
+    capacity = new_capacity;
+    used += new_capacity - old_capacity; // compensate for free() below
+    free(old_capacity, new_capacity - old_capacity);
+}
+
+// ------------------------------------------
+// GeometryArena
+
+GeometryArenaImpl::GeometryArenaImpl(const std::string& name, const std::vector<VertexStream>& layout, uint32_t vertex_capacity, uint32_t index_capacity)
+    : name(name), layout(layout), vao(0), vertex_allocator(vertex_capacity), index_allocator(index_capacity) {
+    glGenVertexArrays(1, &vao);
+    for (uint32_t i = 0; i < layout.size(); ++i)
+        vbos.push_back(create_buffer<VBO>(name + "_vertex_buffer_" + std::to_string(i), size_t(vertex_capacity) * vertex_size(i)));
+    ibo = create_buffer<IBO>(name + "_index_buffer", size_t(index_capacity) * sizeof(uint32_t));
+    setup_vertex_array();
+}
+
+GeometryArenaImpl::~GeometryArenaImpl() {
+    gl_delete_deferred(GLObject::VERTEX_ARRAY, vao);
+}
+
+ArenaAllocation GeometryArenaImpl::allocate(uint32_t num_vertices, uint32_t num_indices) {
+    ArenaAllocation alloc;
+    alloc.num_vertices = num_vertices;
+    alloc.num_indices = num_indices;
+    if (num_vertices > 0 && !vertex_allocator.allocate(num_vertices, alloc.base_vertex)) {
+        grow_vertices(vertex_allocator.capacity + num_vertices);
+        vertex_allocator.allocate(num_vertices, alloc.base_vertex);
+    }
+    if (num_indices > 0 && !index_allocator.allocate(num_indices, alloc.first_index)) {
+        grow_indices(index_allocator.capacity + num_indices);
+        index_allocator.allocate(num_indices, alloc.first_index);
+    }
+    return alloc;
+}
+
+void GeometryArenaImpl::free(const ArenaAllocation& alloc) {
+    vertex_allocator.free(alloc.base_vertex, alloc.num_vertices);
+    index_allocator.free(alloc.first_index, alloc.num_indices);
+}
+
+void GeometryArenaImpl::upload_vertices(const ArenaAllocation& alloc, uint32_t stream, const void* data) {
+    if (stream >= vbos.size())
+        throw std::runtime_error("GeometryArena::upload_vertices: stream out of range!");
+    vbos[stream]->upload_subdata(data, size_t(alloc.base_vertex) * vertex_size(stream), size_t(alloc.num_vertices) * vertex_size(stream));
+}
+
+void GeometryArenaImpl::upload_indices(const ArenaAllocation& alloc, const uint32_t* data) {
+    ibo->upload_subdata(data, size_t(alloc.first_index) * sizeof(uint32_t), size_t(alloc.num_indices) * sizeof(uint32_t));
+}
+
+void* GeometryArenaImpl::map_vertices(const ArenaAllocation& alloc, uint32_t stream, GLbitfield access) const {
+    if (stream >= vbos.size())
+        throw std::runtime_error("GeometryArena::map_vertices: stream out of range!");
+    return vbos[stream]->map_range(size_t(alloc.base_vertex) * vertex_size(stream), size_t(alloc.num_vertices) * vertex_size(stream), access);
+}
+
+void GeometryArenaImpl::unmap_vertices(uint32_t stream) const {
+    vbos[stream]->unmap();
+}
+
+void* GeometryArenaImpl::map_indices(const ArenaAllocation& alloc, GLbitfield access) const {
+    return ibo->map_range(size_t(alloc.first_index) * sizeof(uint32_t), size_t(alloc.num_indices) * sizeof(uint32_t), access);
+}
+
+void GeometryArenaImpl::unmap_indices() const {
+    ibo->unmap();
+}
+
+void GeometryArenaImpl::bind() const {
+    GLState::bind_vertex_array(vao);
+}
+
+void GeometryArenaImpl::unbind() const {
+    GLState::bind_vertex_array(0);
+}
+
+void GeometryArenaImpl::grow_vertices(uint32_t min_capacity) {
+    const uint32_t capacity = std::max(min_capacity, 2 * vertex_allocator.capacity);
+    for (uint32_t i = 0; i < vbos.size(); ++i)
+        vbos[i] = grow_buffer(vbos[i], size_t(capacity) * vertex_size(i));
+    vertex_allocator.grow(capacity);
+    setup_vertex_array();
+}
+
+void GeometryArenaImpl::grow_indices(uint32_t min_capacity) {
+    const uint32_t capacity = std::max(min_capacity, 2 * index_allocator.capacity);
+    ibo = grow_buffer(ibo, size_t(capacity) * sizeof(uint32_t));
+    index_allocator.grow(capacity);
+    setup_vertex_array();
+}
+
+void GeometryArenaImpl::setup_vertex_array() {
+    GLState::bind_vertex_array(vao);
+    for (uint32_t i = 0; i < layout.size(); ++i) {
+        vbos[i]->bind();
+        set_vertex_attrib_pointers(layout[i]);
+    }
+    ibo->bind();
+    GLState::bind_vertex_array(0);
+    GLState::bind_buffer(GL_ARRAY_BUFFER, 0);
+    ibo->unbind();
+}
+
+GeometryArena geometry_arena(const VertexFormat& format, bool has_normals, bool has_texcoords) {
+    const std::string name = "geometry_arena_" + format.key(has_normals, has_texcoords);
+    if (GeometryArena::valid(name))
+        return GeometryArena::find(name);
+    return GeometryArena(name, format.layout(has_normals, has_texcoords));
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "named_handle.h"
+#include "buffer.h"
+#include "vertex_format.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Free-list allocator (first fit, offsets and sizes in elements, adjacent free blocks are merged)
+
+class FreeListAllocator {
+public:
+    FreeListAllocator(uint32_t capacity = 0);
+
+    bool allocate(uint32_t size, uint32_t& offset); // returns false if no free block is large enough
+    void free(uint32_t offset, uint32_t size);
+    void grow(uint32_t new_capacity); // append free space
+
+    // data
+    uint32_t capacity, used;
+    std::map<uint32_t, uint32_t> free_blocks; // offset -> size
+};
+
+// ------------------------------------------
+// GeometryArena (shared vertex and index pools for one vertex layout, sub-allocated by meshes)
+// Each stream of the layout gets its own pool and meshes draw with a base vertex, so indices are kept mesh-local.
+// All meshes of the same layout share one VAO, pools grow on demand (which requires a GPU copy).
+
+struct ArenaAllocation {
+    uint32_t base_vertex = 0;
+    uint32_t num_vertices = 0;
+    uint32_t first_index = 0;
+    uint32_t num_indices = 0;
+};
+
+class GeometryArenaImpl {
+public:
+    GeometryArenaImpl(const std::string& name, const std::vector<VertexStream>& layout, uint32_t vertex_capacity = 1 << 18, uint32_t index_capacity = 1 << 20);
+    virtual ~GeometryArenaImpl();
+
+    // prevent copies and moves, since GL buffers aren't reference counted
+    GeometryArenaImpl(const GeometryArenaImpl&) = delete;
+    GeometryArenaImpl& operator=(const GeometryArenaImpl&) = delete;
+    GeometryArenaImpl& operator=(const GeometryArenaImpl&&) = delete;
+
+    // manage sub-allocations
+    ArenaAllocation allocate(uint32_t num_vertices, uint32_t num_indices);
+    void free(const ArenaAllocation& alloc);
+
+    // upload data of one vertex stream or the indices of an allocation
+    void upload_vertices(const ArenaAllocation& alloc, uint32_t stream, const void* data);
+    void upload_indices(const ArenaAllocation& alloc, const uint32_t* data);
+
+    // map part of a vertex stream or the index pool (see GLBufferImpl::map_range)
+    void* map_vertices(const ArenaAllocation& alloc, uint32_t stream, GLbitfield access) const;
+    void unmap_vertices(uint32_t stream) const;
+    void* map_indices(const ArenaAllocation& alloc, GLbitfield access) const;
+    void unmap_indices() const;
+
+    void bind() const;
+    void unbind() const;
+
+    inline uint32_t vertex_size(uint32_t stream) const { return layout[stream].stride; } // in bytes
+
+    // data
+    const std::string name;
+    const std::vector<VertexStream> layout;
+    GLuint vao;
+    std::vector<VBO> vbos;
+    IBO ibo;
+    FreeListAllocator vertex_allocator;
+    FreeListAllocator index_allocator;
+
+private:
+    void grow_vertices(uint32_t min_capacity);
+    void grow_indices(uint32_t min_capacity);
+    void setup_vertex_array();
+};
+
+using GeometryArena = NamedHandle<GeometryArenaImpl>;
+
+// find or create the shared arena for given vertex format and attribute set
+GeometryArena geometry_arena(const VertexFormat& format, bool has_normals, bool has_texcoords);
+
+CPPGL_NAMESPACE_END
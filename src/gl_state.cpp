@@ -0,0 +1,230 @@
+#include "gl_state.h"
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+bool GLState::dsa = false;
+
+// ------------------------------------------
+// state
+
+static const GLuint UNKNOWN = GLuint(-1);
+static const uint32_t MAX_UNITS = 32; // higher units are forwarded without caching
+
+static const GLenum TEXTURE_TARGETS[] = { GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_2D_MULTISAMPLE };
+static const GLenum BUFFER_TARGETS[] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER };
+static const GLenum CAPS[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST };
+static const size_t NUM_TEXTURE_TARGETS = sizeof(TEXTURE_TARGETS) / sizeof(GLenum);
+static const size_t NUM_BUFFER_TARGETS = sizeof(BUFFER_TARGETS) / sizeof(GLenum);
+static const size_t NUM_CAPS = sizeof(CAPS) / sizeof(GLenum);
+
+struct Shadow {
+    GLuint program, vao, draw_fbo, read_fbo;
+    GLuint active_unit;
+    GLuint textures[MAX_UNITS][NUM_TEXTURE_TARGETS];
+    GLuint buffers[NUM_BUFFER_TARGETS];
+    GLint viewport[4];
+    GLuint caps[NUM_CAPS]; // 0/1
+    GLuint blend_src, blend_dst, depth_func, depth_mask, cull_face;
+};
+
+// all state unknown, so the next request passes
+static Shadow unknown_shadow() {
+    Shadow s;
+    s.program = s.vao = s.draw_fbo = s.read_fbo = s.active_unit = UNKNOWN;
+    for (auto& unit : s.textures)
+        std::fill(unit, unit + NUM_TEXTURE_TARGETS, UNKNOWN);
+    std::fill(s.buffers, s.buffers + NUM_BUFFER_TARGETS, UNKNOWN);
+    std::fill(s.viewport, s.viewport + 4, -1);
+    std::fill(s.caps, s.caps + NUM_CAPS, UNKNOWN);
+    s.blend_src = s.blend_dst = s.depth_func = s.depth_mask = s.cull_face = UNKNOWN;
+    return s;
+}
+
+static Shadow shadow = unknown_shadow();
+static GLStateStats current, last;
+
+// ------------------------------------------
+// helper funcs
+
+template <size_t N> static inline int target_index(const GLenum (&targets)[N], GLenum target) {
+    for (size_t i = 0; i < N; ++i)
+        if (targets[i] == target) return int(i);
+    return -1;
+}
+
+// count request and update shadow, returns true if the GL call can be skipped
+static inline bool redundant(GLuint& value, GLuint requested) {
+    current.calls++;
+    if (value == requested) {
+        current.skipped++;
+        return true;
+    }
+    value = requested;
+    return false;
+}
+
+// ------------------------------------------
+// GLState
+
+void GLState::use_program(GLuint program) {
+    if (!redundant(shadow.program, program))
+        glUseProgram(program);
+}
+
+void GLState::bind_vertex_array(GLuint vao) {
+    if (redundant(shadow.vao, vao)) return;
+    glBindVertexArray(vao);
+    shadow.buffers[target_index(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN; // part of the VAO state
+}
+
+void GLState::active_texture(uint32_t unit) {
+    if (!redundant(shadow.active_unit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bind_texture(GLenum target, GLuint texture) {
+    const int index = target_index(TEXTURE_TARGETS, target);
+    if (index < 0 || shadow.active_unit >= MAX_UNITS) {
+        current.calls++;
+        glBindTexture(target, texture);
+    } else if (!redundant(shadow.textures[shadow.active_unit][index], texture))
+        glBindTexture(target, texture);
+}
+
+void GLState::bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+    const int index = target_index(TEXTURE_TARGETS, target);
+    if (index >= 0 && unit < MAX_UNITS && shadow.textures[unit][index] == texture) {
+        current.calls++;
+        current.skipped++; // don't even switch the active unit
+        return;
+    }
+    active_texture(unit);
+    bind_texture(target, texture);
+}
+
+void GLState::bind_buffer(GLenum target, GLuint buffer) {
+    const int index = target_index(BUFFER_TARGETS, target);
+    if (index < 0) {
+        current.calls++;
+        glBindBuffer(target, buffer);
+    } else if (!redundant(shadow.buffers[index], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GLState::bind_buffer_base(GLenum target, uint32_t index, GLuint buffer) {
+    current.calls++;
+    glBindBufferBase(target, index, buffer);
+    const int target_idx = target_index(BUFFER_TARGETS, target);
+    if (target_idx >= 0) shadow.buffers[target_idx] = buffer;
+}
+
+void GLState::bind_buffer_range(GLenum target, uint32_t index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    current.calls++;
+    glBindBufferRange(target, index, buffer, offset, size);
+    const int target_idx = target_index(BUFFER_TARGETS, target);
+    if (target_idx >= 0) shadow.buffers[target_idx] = buffer;
+}
+
+void GLState::bind_framebuffer(GLenum target, GLuint fbo) {
+    current.calls++;
+    const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    if ((!draw || shadow.draw_fbo == fbo) && (!read || shadow.read_fbo == fbo)) {
+        current.skipped++;
+        return;
+    }
+    glBindFramebuffer(target, fbo);
+    if (draw) shadow.draw_fbo = fbo;
+    if (read) shadow.read_fbo = fbo;
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+    current.calls++;
+    if (shadow.viewport[0] == x && shadow.viewport[1] == y && shadow.viewport[2] == w && shadow.viewport[3] == h) {
+        current.skipped++;
+        return;
+    }
+    glViewport(x, y, w, h);
+    shadow.viewport[0] = x;
+    shadow.viewport[1] = y;
+    shadow.viewport[2] = w;
+    shadow.viewport[3] = h;
+}
+
+void GLState::get_viewport(GLint vp[4]) {
+    if (shadow.viewport[2] < 0)
+        glGetIntegerv(GL_VIEWPORT, shadow.viewport);
+    std::copy(shadow.viewport, shadow.viewport + 4, vp);
+}
+
+void GLState::enable(GLenum cap, bool on) {
+    const int index = target_index(CAPS, cap);
+    if (index >= 0 && redundant(shadow.caps[index], on ? 1 : 0)) return;
+    if (index < 0) current.calls++;
+    if (on)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void GLState::blend_func(GLenum src, GLenum dst) {
+    current.calls++;
+    if (shadow.blend_src == src && shadow.blend_dst == dst) {
+        current.skipped++;
+        return;
+    }
+    glBlendFunc(src, dst);
+    shadow.blend_src = src;
+    shadow.blend_dst = dst;
+}
+
+void GLState::depth_func(GLenum func) {
+    if (!redundant(shadow.depth_func, func))
+        glDepthFunc(func);
+}
+
+void GLState::depth_mask(bool write) {
+    if (!redundant(shadow.depth_mask, write ? GL_TRUE : GL_FALSE))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::cull_face(GLenum mode) {
+    if (!redundant(shadow.cull_face, mode))
+        glCullFace(mode);
+}
+
+void GLState::forget(GLObject type, GLuint id) {
+    if (id == 0) return;
+    auto drop = [id](GLuint& value) { if (value == id) value = UNKNOWN; };
+    switch (type) {
+    case GLObject::BUFFER:
+        for (GLuint& buffer : shadow.buffers) drop(buffer);
+        break;
+    case GLObject::TEXTURE:
+        for (auto& unit : shadow.textures)
+            for (GLuint& texture : unit) drop(texture);
+        break;
+    case GLObject::VERTEX_ARRAY: drop(shadow.vao); break;
+    case GLObject::FRAMEBUFFER: drop(shadow.draw_fbo); drop(shadow.read_fbo); break;
+    case GLObject::PROGRAM: drop(shadow.program); break;
+    default: break;
+    }
+}
+
+void GLState::invalidate() {
+    shadow = unknown_shadow();
+}
+
+void GLState::next_frame() {
+    last = current;
+    current = GLStateStats();
+    invalidate();
+}
+
+GLStateStats GLState::stats() {
+    return last;
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "platform.h"
+#include "deletion_queue.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Global GL backend state
+
+struct GLStateStats {
+    uint64_t calls = 0; // state changes requested via GLState
+    uint64_t skipped = 0; // redundant ones, filtered out
+};
+
+struct GLState {
+    // direct state access backend: buffers and textures are created and edited via glNamed*/glTexture* without
+    // touching binding points and use immutable storage where the size is known up front
+    // (selected at context creation via ContextParameters::direct_state_access, requires GL 4.5 or ARB_direct_state_access)
+    static bool dsa;
+
+    // state cache: CPU-side shadow of binding and fixed function state, requests matching the shadowed value
+    // don't reach the driver. State starts unknown (first request always passes) and is invalidated each frame.
+    // Note: raw GL calls changing any of this state (e.g. in user code) have to be followed by invalidate()
+    static void use_program(GLuint program);
+    static void bind_vertex_array(GLuint vao);
+    static void active_texture(uint32_t unit);
+    static void bind_texture(GLenum target, GLuint texture); // on the active unit
+    static void bind_texture(uint32_t unit, GLenum target, GLuint texture);
+    static void bind_buffer(GLenum target, GLuint buffer);
+    // indexed binds are always forwarded, but also change the generic binding of the target
+    static void bind_buffer_base(GLenum target, uint32_t index, GLuint buffer);
+    static void bind_buffer_range(GLenum target, uint32_t index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    static void bind_framebuffer(GLenum target, GLuint fbo);
+    static void viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+    static void get_viewport(GLint vp[4]); // from the shadow, queried only if unknown
+    static void enable(GLenum cap, bool on = true);
+    static inline void disable(GLenum cap) { enable(cap, false); }
+    static void blend_func(GLenum src, GLenum dst);
+    static void depth_func(GLenum func);
+    static void depth_mask(bool write);
+    static void cull_face(GLenum mode);
+
+    // drop shadowed bindings of a deleted object, as its name may be reused (called by the deletion queue)
+    static void forget(GLObject type, GLuint id);
+    // mark all shadowed state unknown
+    static void invalidate();
+    // reset per-frame counters and invalidate (called once per frame by Context::swap_buffers)
+    static void next_frame();
+    // counters of the last frame
+    static GLStateStats stats();
+};
+
+CPPGL_NAMESPACE_END
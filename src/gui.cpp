@@ -1,6 +1,8 @@
 #include "gui.h"
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
+#include "frame_capture.h"
+#include "gl_state.h"
 #include <map>
 
 CPPGL_NAMESPACE_BEGIN
@@ -29,6 +31,8 @@ void gui_draw() {
     window_length +=    entry_length*TimerQueryGL::map.size();
     window_length +=    entry_length*PrimitiveQueryGL::map.size();
     window_length +=    entry_length*FragmentQueryGL::map.size();
+    window_length +=    entry_length*CounterQuery::map.size();
+    window_length +=    entry_length / 2; // GL state stats
 
     // timers
     ImGui::SetNextWindowPos(ImVec2(0, 20));
@@ -52,6 +56,13 @@ void gui_draw() {
             ImGui::Separator();
             gui_display_query_counter(*query, name.c_str());
         }
+        for (const auto& [name, query] : CounterQuery::map) {
+            ImGui::Separator();
+            gui_display_query_count(*query, name.c_str());
+        }
+        const GLStateStats gl_stats = GLState::stats();
+        ImGui::Separator();
+        ImGui::Text("GL state changes: %llu, skipped: %llu", (unsigned long long)gl_stats.calls, (unsigned long long)gl_stats.skipped);
     }
     ImGui::PopStyleVar();
     ImGui::PopStyleColor();
@@ -86,6 +97,17 @@ void gui_draw() {
         ImGui::Separator();
         if (ImGui::Button("Screenshot"))
             Context::screenshot("screenshot.png");
+        if (ImGui::Button(frame_capture_active() ? "Stop capture" : "Capture")) {
+            if (frame_capture_active())
+                frame_capture_stop();
+            else
+                frame_capture_start();
+        }
+        if (frame_capture_active()) {
+            const FrameCaptureStats stats = frame_capture_stats();
+            ImGui::Text("captured: %llu, written: %llu, dropped: %llu, in flight: %u, queued: %u", (unsigned long long)stats.captured,
+                    (unsigned long long)stats.written, (unsigned long long)stats.dropped, stats.in_flight, stats.queued);
+        }
         ImGui::EndMainMenuBar();
     }
 
@@ -229,9 +251,9 @@ void gui_display_texture(const Texture2D& tex, const glm::ivec2& size) {
     ImGui::Text("ID: %u, size: %ux%u", tex->id, tex->w, tex->h);
     ImGui::Text("internal_format: %u, format %u, type: %u", tex->internal_format, tex->format, tex->type);
     ImGui::Image((ImTextureID)size_t(tex->id), ImVec2(size.x, size.y), ImVec2(0, 1), ImVec2(1, 0), ImVec4(1, 1, 1, 1), ImVec4(1, 1, 1, 0.5));
-    if (ImGui::Button(("Save PNG##" + tex->name).c_str())) tex->save_ldr(fs::path(tex->name).filename().replace_extension(".png"));
+    if (ImGui::Button(("Save PNG##" + tex->name).c_str())) tex->save_ldr(fs::path(tex->name).filename().replace_extension(".png"), true, true);
     ImGui::SameLine();
-    if (ImGui::Button(("Save JPEG##" + tex->name).c_str())) tex->save_ldr(fs::path(tex->name).filename().replace_extension(".jpg"));
+    if (ImGui::Button(("Save JPEG##" + tex->name).c_str())) tex->save_ldr(fs::path(tex->name).filename().replace_extension(".jpg"), true, true);
     ImGui::Unindent();
 }
 
@@ -400,4 +422,14 @@ void gui_display_query_counter(const Query& query, const char* label) {
     ImGui::PopStyleColor();
 }
 
+void gui_display_query_count(const Query& query, const char* label) {
+    const float avg = query.exp_avg;
+    const float lower = query.min();
+    const float upper = query.max();
+    ImGui::Text("avg: %u, min: %u, max: %u", uint32_t(avg), uint32_t(lower), uint32_t(upper));
+    ImGui::PushStyleColor(ImGuiCol_PlotHistogram, ImVec4(0, .7, .7, 1));
+    ImGui::PlotHistogram(label, query.data.data(), query.data.size(), query.curr, 0, 0.f, std::max(upper, 1.f), ImVec2(0, 30));
+    ImGui::PopStyleColor();
+}
+
 CPPGL_NAMESPACE_END
@@ -4,15 +4,17 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stbi/stb_image_write.h"
 #include <algorithm>
+#include <iostream>
 #include <thread>
+#include "thread_pool.h"
 
 CPPGL_NAMESPACE_BEGIN
 
 ///////////////////////
 //load
 
-std::tuple<std::vector<uint8_t>, int, int, int, bool> image_load(const std::filesystem::path& path, bool flip) {
-    stbi_set_flip_vertically_on_load(flip); // important: the default value for this is different on windows and linux
+ImageData image_load(const std::filesystem::path& path, bool flip) {
+    stbi_set_flip_vertically_on_load_thread(flip); // important: the default value for this is different on windows and linux
 
     uint8_t* data = 0;
     int w_out, h_out, channels_out;
@@ -40,6 +42,28 @@ std::tuple<std::vector<uint8_t>, int, int, int, bool> image_load(const std::file
     return { data_out, w_out, h_out, channels_out, is_hdr_out };
 }
 
+std::map<std::filesystem::path, ImageData> image_load_parallel(const std::vector<std::filesystem::path>& paths, bool flip) {
+    // remove duplicates
+    std::vector<std::filesystem::path> unique_paths = paths;
+    std::sort(unique_paths.begin(), unique_paths.end());
+    unique_paths.erase(std::unique(unique_paths.begin(), unique_paths.end()), unique_paths.end());
+    // decode
+    std::vector<ImageData> images(unique_paths.size());
+    std::vector<uint8_t> success(unique_paths.size(), 0); // no vector<bool>, elements are written concurrently
+    parallel_for(unique_paths.size(), [&](size_t i) {
+        try {
+            images[i] = image_load(unique_paths[i], flip);
+            success[i] = 1;
+        } catch (std::exception& e) {
+            std::cerr << "WARN: " << e.what() << std::endl;
+        }
+    });
+    std::map<std::filesystem::path, ImageData> result;
+    for (size_t i = 0; i < unique_paths.size(); ++i)
+        if (success[i]) result[unique_paths[i]] = std::move(images[i]);
+    return result;
+}
+
 ///////////////////////
 //save
 
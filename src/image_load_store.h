@@ -1,14 +1,21 @@
 #pragma once
+#include <map>
+#include <tuple>
 #include <vector>
 #include <filesystem>
 #include "platform.h"
 
 CPPGL_NAMESPACE_BEGIN
 
-// Return values: image data, width, height, channels, is_hdr
-// Usage: auto [data, w, h, c, is_hdr] = load_image(path);
+// Decoded image: image data, width, height, channels, is_hdr
 // Note: if is_hdr is set, image data is of type float stored as byte array
-std::tuple<std::vector<uint8_t>, int, int, int, bool> image_load(const std::filesystem::path& path, bool flip = true);
+using ImageData = std::tuple<std::vector<uint8_t>, int, int, int, bool>;
+
+// Usage: auto [data, w, h, c, is_hdr] = load_image(path);
+ImageData image_load(const std::filesystem::path& path, bool flip = true);
+
+// Decode multiple images in parallel on the global thread pool (duplicates are decoded once, failed loads are omitted)
+std::map<std::filesystem::path, ImageData> image_load_parallel(const std::vector<std::filesystem::path>& paths, bool flip = true);
 
 // Write LDR image to disk, supported file formats: .png, .jpg/.jpeg, .tga, .bmp
 void image_store_ldr(const std::filesystem::path& path, const uint8_t* image_data, int w, int h, int channels, bool flip = true, bool async = false);
@@ -2,6 +2,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include <memory>
 #include <filesystem>
 namespace fs = std::filesystem;
@@ -21,9 +22,13 @@ CPPGL_NAMESPACE_BEGIN
 class MaterialImpl {
 public:
     MaterialImpl(const std::string& name);
-    MaterialImpl(const std::string& name, const fs::path& base_path, const aiMaterial* mat_ai);
+    MaterialImpl(const std::string& name, const fs::path& base_path, const aiMaterial* mat_ai,
+            const std::map<fs::path, ImageData>& images = std::map<fs::path, ImageData>());
     virtual ~MaterialImpl();
 
+    // paths of all texture files referenced by given assimp material (e.g. to decode them in advance via image_load_parallel)
+    static std::vector<fs::path> texture_paths(const fs::path& base_path, const aiMaterial* mat_ai);
+
     void bind(const Shader& shader) const;
     void unbind() const;
 
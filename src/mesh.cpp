@@ -7,52 +7,67 @@
 #include <assimp/mesh.h>
 #include <assimp/material.h>
 #include "buffer.h"
+#include "deletion_queue.h"
+#include "gl_state.h"
+#include "mesh_cache.h"
+#include "thread_pool.h"
+#include "image_load_store.h"
 
 CPPGL_NAMESPACE_BEGIN
 
 // ------------------------------------------
 // helper funcs
 
-inline uint32_t type_to_bytes(GLenum type) {
-    switch (type) {
-    case GL_BYTE:
-    case GL_UNSIGNED_BYTE:
-        return 1;
-    case GL_SHORT:
-    case GL_UNSIGNED_SHORT:
-    case GL_HALF_FLOAT:
-        return 2;
-    case GL_FLOAT:
-    case GL_FIXED:
-    case GL_INT:
-    case GL_UNSIGNED_INT:
-        return 4;
-    case GL_DOUBLE:
-        return 8;
+static GLbitfield access_to_bits(GLenum access) {
+    switch (access) {
+    case GL_READ_ONLY:
+        return GL_MAP_READ_BIT;
+    case GL_WRITE_ONLY:
+        return GL_MAP_WRITE_BIT;
     default:
-        throw std::runtime_error("Unknown GL type!");
+        return GL_MAP_READ_BIT | GL_MAP_WRITE_BIT;
     }
 }
 
+// immutable storage with the DSA backend (still updatable and mappable), regular reallocatable storage otherwise
+template <typename BufferT> static void allocate_buffer(BufferT& buffer, const void* data, size_t size_bytes, GLenum hint) {
+    if (GLState::dsa && size_bytes > 0)
+        buffer->storage(data, size_bytes, GL_DYNAMIC_STORAGE_BIT | GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+    else
+        buffer->upload_data(data, size_bytes, hint);
+}
+
 // ------------------------------------------
 // MeshImpl
 
+bool MeshImpl::use_geometry_arena = false;
+VertexFormat MeshImpl::default_vertex_format = VertexFormat::separate();
+
 MeshImpl::MeshImpl(const std::string& name, const Geometry& geometry, const Material& material)
-    : name(name), geometry(geometry), material(material), vao(0), num_vertices(0), num_indices(0), primitive_type(GL_TRIANGLES) {
+    : name(name), geometry(geometry), material(material), vao(0), num_vertices(0), num_indices(0), primitive_type(GL_TRIANGLES),
+    vertex_format(default_vertex_format), position_decode(1), bb_min(0), bb_max(0) {
     glGenVertexArrays(1, &vao);
     upload_gpu();
 }
 
 MeshImpl::~MeshImpl() {
-    clear_gpu();
-    glDeleteVertexArrays(1, &vao);
+    // the last handle might be dropped by a worker thread, so release the arena range on the context thread once the GPU is done
+    if (arena)
+        gl_defer([arena = arena, allocation = allocation]() mutable { arena->free(allocation); });
+    gl_delete_deferred(GLObject::VERTEX_ARRAY, vao);
 }
 
 void MeshImpl::clear_gpu() {
+    if (arena) {
+        arena->free(allocation);
+        arena = GeometryArena();
+        allocation = ArenaAllocation();
+    }
     ibo = IBO();
     vbos.clear();
     vbo_types.clear();
     vbo_dims.clear();
+    lods.clear();
     num_vertices = num_indices = 0;
 }
 
@@ -60,35 +75,109 @@ void MeshImpl::upload_gpu() {
     if (!geometry) return;
     // free gpu resources
     clear_gpu();
-    // (re-)upload data to GL
-    add_vertex_buffer(GL_FLOAT, 3, uint32_t(geometry->positions.size()), geometry->positions.data());
-    if (geometry->has_normals())
-        add_vertex_buffer(GL_FLOAT, 3, uint32_t(geometry->normals.size()), geometry->normals.data());
-    if (geometry->has_texcoords())
-        add_vertex_buffer(GL_FLOAT, 2, uint32_t(geometry->texcoords.size()), geometry->texcoords.data());
-    add_index_buffer(uint32_t(geometry->indices.size()), geometry->indices.data());
+    position_decode = glm::mat4(1);
+    if (geometry->positions.empty())
+        bb_min = bb_max = glm::vec3(0);
+    else {
+        bb_min = geometry->bb_min;
+        bb_max = geometry->bb_max;
+    }
+    // append levels of detail to the index buffer
+    std::vector<uint32_t> lod_indices;
+    if (!geometry->indices.empty())
+        lods.push_back(MeshLod{ 0, uint32_t(geometry->indices.size()), 0.f });
+    if (!geometry->lods.empty()) {
+        lod_indices = geometry->indices;
+        for (const auto& lod : geometry->lods) {
+            lods.push_back(MeshLod{ uint32_t(lod_indices.size()), uint32_t(lod.indices.size()), lod.error });
+            lod_indices.insert(lod_indices.end(), lod.indices.begin(), lod.indices.end());
+        }
+    }
+    const std::vector<uint32_t>& indices = lod_indices.empty() ? geometry->indices : lod_indices;
+    if (vertex_format == VertexFormat::separate() && !use_geometry_arena) {
+        // default layout, upload directly without encoding
+        add_vertex_buffer(GL_FLOAT, 3, uint32_t(geometry->positions.size()), geometry->positions.data());
+        if (geometry->has_normals())
+            add_vertex_buffer(GL_FLOAT, 3, uint32_t(geometry->normals.size()), geometry->normals.data());
+        if (geometry->has_texcoords())
+            add_vertex_buffer(GL_FLOAT, 2, uint32_t(geometry->texcoords.size()), geometry->texcoords.data());
+        add_index_buffer(uint32_t(indices.size()), indices.data());
+        num_indices = uint32_t(geometry->indices.size()); // full detail only
+        return;
+    }
+    // encode vertices into streams of the requested format
+    const bool has_normals = geometry->has_normals(), has_texcoords = geometry->has_texcoords();
+    const std::vector<VertexStream> layout = vertex_format.layout(has_normals, has_texcoords);
+    const std::vector<std::vector<uint8_t>> streams = encode_vertices(*geometry, vertex_format, position_decode);
+    if (use_geometry_arena) {
+        // sub-allocate from shared arena
+        arena = geometry_arena(vertex_format, has_normals, has_texcoords);
+        num_vertices = uint32_t(geometry->positions.size());
+        allocation = arena->allocate(num_vertices, uint32_t(indices.size()));
+        for (uint32_t i = 0; i < layout.size(); ++i) {
+            arena->upload_vertices(allocation, i, streams[i].data());
+            vbo_types.push_back(GL_UNSIGNED_BYTE);
+            vbo_dims.push_back(layout[i].stride);
+        }
+        if (!indices.empty())
+            arena->upload_indices(allocation, indices.data());
+    } else {
+        for (uint32_t i = 0; i < layout.size(); ++i)
+            add_vertex_stream(layout[i], uint32_t(geometry->positions.size()), streams[i].data());
+        add_index_buffer(uint32_t(indices.size()), indices.data());
+    }
+    num_indices = uint32_t(geometry->indices.size()); // full detail only
 }
 
 void MeshImpl::bind(const Shader& shader) const {
-    glBindVertexArray(vao);
+    GLState::bind_vertex_array(vertex_array());
     if (material)
         material->bind(shader);
 }
 
-void MeshImpl::draw() const {
-    if (ibo)
-        glDrawElements(primitive_type, num_indices, GL_UNSIGNED_INT, 0);
+void MeshImpl::draw(uint32_t lod) const {
+    const MeshLod level = lod < lods.size() ? lods[lod] : MeshLod{ 0, num_indices, 0.f };
+    if (arena) {
+        if (num_indices > 0)
+            glDrawElementsBaseVertex(primitive_type, level.num_indices, GL_UNSIGNED_INT,
+                    (const void*)(size_t(allocation.first_index + level.first_index) * sizeof(uint32_t)), allocation.base_vertex);
+        else
+            glDrawArrays(primitive_type, allocation.base_vertex, num_vertices);
+    } else if (ibo)
+        glDrawElements(primitive_type, level.num_indices, GL_UNSIGNED_INT, (const void*)(size_t(level.first_index) * sizeof(uint32_t)));
     else
         glDrawArrays(primitive_type, 0, num_vertices);
 }
 
+uint32_t MeshImpl::select_lod(const glm::mat4& model, const Camera& cam, float threshold) const {
+    if (lods.size() <= 1 || threshold < 0.f) return 0;
+    // bounding sphere in world space
+    const glm::vec3 center = glm::vec3(model * glm::vec4((bb_min + bb_max) * 0.5f, 1.f));
+    const float scale = std::sqrt(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+    const float radius = glm::length(bb_max - bb_min) * 0.5f * scale;
+    // projected size of one world unit as fraction of the viewport height
+    float projected = cam->proj[1][1] * 0.5f;
+    if (cam->perspective) {
+        const float distance = glm::length(center - cam->pos) - radius;
+        if (distance <= cam->near) return 0;
+        projected /= distance;
+    }
+    uint32_t lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error * scale * projected <= threshold)
+        lod++;
+    return lod;
+}
+
 void MeshImpl::unbind() const {
-    glBindVertexArray(0);
+    GLState::bind_vertex_array(0);
     if (material)
         material->unbind();
 }
 
 uint32_t MeshImpl::add_vertex_buffer(GLenum type, uint32_t element_dim, uint32_t num_vertices, const void* data, GLenum hint) {
+    if (arena)
+        throw std::runtime_error("Mesh::add_vertex_buffer: mesh is stored in a geometry arena!");
     if (this->num_vertices && this->num_vertices != num_vertices)
         throw std::runtime_error("Mesh::add_vertex_buffer: vertex buffer size mismatch!");
     // setup vbo
@@ -96,11 +185,11 @@ uint32_t MeshImpl::add_vertex_buffer(GLenum type, uint32_t element_dim, uint32_t
 
     const uint32_t buf_id = vbos.size();
     vbos.emplace_back(name + "_vertex_buffer_" + std::to_string(buf_id));
-    vbos[buf_id]->upload_data(data, type_to_bytes(type) * element_dim * num_vertices, hint);
+    allocate_buffer(vbos[buf_id], data, type_to_bytes(type) * element_dim * num_vertices, hint);
     vbo_types.push_back(type);
     vbo_dims.push_back(element_dim);
     // setup vertex attributes
-    glBindVertexArray(vao);
+    GLState::bind_vertex_array(vao);
     vbos[buf_id]->bind();;
     glEnableVertexAttribArray(buf_id);
     if (type == GL_BYTE || type == GL_UNSIGNED_BYTE ||
@@ -111,23 +200,49 @@ uint32_t MeshImpl::add_vertex_buffer(GLenum type, uint32_t element_dim, uint32_t
         glVertexAttribLPointer(buf_id, element_dim, type, 0, 0);
     else
         glVertexAttribPointer(buf_id, element_dim, type, GL_FALSE, 0, 0);
-    glBindVertexArray(0);
+    GLState::bind_vertex_array(0);
+    vbos[buf_id]->unbind();
+    return buf_id;
+}
+
+uint32_t MeshImpl::add_vertex_stream(const VertexStream& stream, uint32_t num_vertices, const void* data, GLenum hint) {
+    if (arena)
+        throw std::runtime_error("Mesh::add_vertex_stream: mesh is stored in a geometry arena!");
+    if (this->num_vertices && this->num_vertices != num_vertices)
+        throw std::runtime_error("Mesh::add_vertex_stream: vertex buffer size mismatch!");
+    // setup vbo
+    this->num_vertices = num_vertices;
+
+    const uint32_t buf_id = vbos.size();
+    vbos.emplace_back(name + "_vertex_buffer_" + std::to_string(buf_id));
+    allocate_buffer(vbos[buf_id], data, size_t(stream.stride) * num_vertices, hint);
+    vbo_types.push_back(GL_UNSIGNED_BYTE);
+    vbo_dims.push_back(stream.stride);
+    // setup vertex attributes
+    GLState::bind_vertex_array(vao);
+    vbos[buf_id]->bind();
+    set_vertex_attrib_pointers(stream);
+    GLState::bind_vertex_array(0);
     vbos[buf_id]->unbind();
     return buf_id;
 }
 
 void MeshImpl::add_index_buffer(uint32_t num_indices, const uint32_t* data, GLenum hint) {
+    if (arena)
+        throw std::runtime_error("Mesh::add_index_buffer: mesh is stored in a geometry arena!");
     this->num_indices = num_indices;
     ibo = IBO(name + "_index_buffer");
-    ibo->upload_data(data, sizeof(uint32_t) * num_indices, hint);
+    allocate_buffer(ibo, data, sizeof(uint32_t) * num_indices, hint);
     // setup vao+ibo
-    glBindVertexArray(vao);
+    GLState::bind_vertex_array(vao);
     ibo->bind();
-    glBindVertexArray(0);
+    GLState::bind_vertex_array(0);
     ibo->unbind();
 }
 
 void MeshImpl::update_vertex_buffer(uint32_t buf_id, const void* data) {
+    if (arena)
+        return arena->upload_vertices(allocation, buf_id, data);
     if (buf_id >= vbos.size())
         throw std::runtime_error("Mesh::update_vertex_buffer: buffer id out of range!");
     vbos[buf_id]->upload_subdata(data, 0, type_to_bytes(vbo_types[buf_id]) * vbo_dims[buf_id] * num_vertices);
@@ -138,48 +253,99 @@ void MeshImpl::set_primitive_type(GLenum primitive_type) {
 }
 
 void* MeshImpl::map_vbo(uint32_t buf_id, GLenum access) const {
+    if (arena)
+        return arena->map_vertices(allocation, buf_id, access_to_bits(access));
     if (buf_id >= vbos.size())
         throw std::runtime_error("Mesh::map_vbo: buffer id out of range!");
     return vbos[buf_id]->map(access);
 }
 
 void MeshImpl::unmap_vbo(uint32_t buf_id) const {
+    if (arena)
+        return arena->unmap_vertices(buf_id);
     if (buf_id >= vbos.size())
         throw std::runtime_error("Mesh::map_vbo: buffer id out of range!");
     vbos[buf_id]->unmap();
 }
 
 void* MeshImpl::map_ibo(GLenum access) const {
+    if (arena && num_indices > 0)
+        return arena->map_indices(allocation, access_to_bits(access));
     if (!ibo)
         throw std::runtime_error("Mesh::map_ibo: no index buffer present!");
     return ibo->map(access);
 }
 
 void MeshImpl::unmap_ibo() const {
+    if (arena)
+        return arena->unmap_indices();
     ibo->unmap();
 }
 
 // ------------------------------------------
 // Mesh loader (Ass-Imp)
 
-std::vector<std::pair<Geometry, Material>> load_meshes_cpu(const fs::path& path, bool normalize) {
-    // load from disk
-    Assimp::Importer importer;
-    std::cout << "Loading: " << path << "..." << std::endl;
-    const aiScene* scene_ai = importer.ReadFile(path.string(), aiProcess_Triangulate | aiProcess_GenSmoothNormals);// | aiProcess_FlipUVs);
-    if (!scene_ai) // handle error
-        throw std::runtime_error("ERROR: Failed to load file: " + path.string() + "!");
-    const std::string base_name = path.filename().replace_extension("").string();
-    // load geometries
-    std::vector<Geometry> geometries;
-    for (uint32_t i = 0; i < scene_ai->mNumMeshes; ++i) {
-        const aiMesh* ai_mesh = scene_ai->mMeshes[i];
-        geometries.push_back(Geometry(base_name + "_" + ai_mesh->mName.C_Str() + "_" + std::to_string(i), ai_mesh));
+std::vector<std::pair<Geometry, Material>> load_meshes_cpu(const fs::path& path, bool normalize, bool optimize) {
+    const uint32_t import_flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals;// | aiProcess_FlipUVs;
+    const uint64_t cache_flags = import_flags | (optimize ? MESH_CACHE_OPTIMIZED : 0);
+    std::vector<std::pair<Geometry, Material>> result;
+    // try binary cache first
+    if (!mesh_cache_load(path, cache_flags, result)) {
+        // load from disk
+        Assimp::Importer importer;
+        std::cout << "Loading: " << path << "..." << std::endl;
+        const aiScene* scene_ai = importer.ReadFile(path.string(), import_flags);
+        if (!scene_ai) // handle error
+            throw std::runtime_error("ERROR: Failed to load file: " + path.string() + "!");
+        const std::string base_name = path.filename().replace_extension("").string();
+        // load (and optimize) geometries in parallel
+        std::vector<Geometry> geometries(scene_ai->mNumMeshes);
+        std::vector<float> acmr_before(scene_ai->mNumMeshes), acmr_after(scene_ai->mNumMeshes);
+        parallel_for(scene_ai->mNumMeshes, [&](size_t i) {
+            const aiMesh* ai_mesh = scene_ai->mMeshes[i];
+            geometries[i] = Geometry(base_name + "_" + ai_mesh->mName.C_Str() + "_" + std::to_string(i), ai_mesh);
+            if (optimize) {
+                acmr_before[i] = geometries[i]->acmr();
+                geometries[i]->optimize();
+                acmr_after[i] = geometries[i]->acmr();
+            }
+        });
+        if (optimize) {
+            // report triangle weighted ACMR
+            double before = 0, after = 0, num_triangles = 0;
+            for (uint32_t i = 0; i < scene_ai->mNumMeshes; ++i) {
+                const double n = double(geometries[i]->indices.size() / 3);
+                before += acmr_before[i] * n;
+                after += acmr_after[i] * n;
+                num_triangles += n;
+            }
+            if (num_triangles > 0)
+                std::cout << "Optimized: " << path << ", ACMR: " << before / num_triangles << " -> " << after / num_triangles << std::endl;
+        }
+        // decode material textures (in parallel)
+        std::vector<fs::path> texture_paths;
+        for (uint32_t i = 0; i < scene_ai->mNumMaterials; ++i) {
+            const auto paths = MaterialImpl::texture_paths(path.parent_path(), scene_ai->mMaterials[i]);
+            texture_paths.insert(texture_paths.end(), paths.begin(), paths.end());
+        }
+        const std::map<fs::path, ImageData> images = image_load_parallel(texture_paths);
+        // load materials (GL textures have to be created on the context thread)
+        std::vector<Material> materials;
+        for (uint32_t i = 0; i < scene_ai->mNumMaterials; ++i) {
+            aiString name_ai;
+            scene_ai->mMaterials[i]->Get(AI_MATKEY_NAME, name_ai);
+            materials.push_back(Material(base_name + "_" + name_ai.C_Str(), path.parent_path(), scene_ai->mMaterials[i], images));
+        }
+        // link geometry <-> material
+        for (uint32_t i = 0; i < scene_ai->mNumMeshes; ++i)
+            result.push_back(std::make_pair(geometries[i], materials[scene_ai->mMeshes[i]->mMaterialIndex]));
+        // store for next time
+        mesh_cache_store(path, cache_flags, result);
     }
     // move and scale geometry to fit into [-1, 1]^3?
     if (normalize) {
-        glm::vec3 bb_min(FLT_MAX), bb_max(FLT_MIN);
-        for (const auto& geom : geometries) {
+        glm::vec3 bb_min(FLT_MAX), bb_max(-FLT_MAX);
+        for (const auto& [geom, mat] : result) {
             bb_min = glm::min(bb_min, geom->bb_min);
             bb_max = glm::max(bb_max, geom->bb_max);
         }
@@ -187,29 +353,18 @@ std::vector<std::pair<Geometry, Material>> load_meshes_cpu(const fs::path& path,
         const glm::vec3 max = glm::vec3(1), min = glm::vec3(-1);
         const glm::vec3 scale_v = (max - min) / (bb_max - bb_min);
         const float scale_f = std::min(scale_v.x, std::min(scale_v.y, scale_v.z));
-        for (auto& geom : geometries) {
+        for (auto& [geom, mat] : result) {
             geom->translate(-center);
             geom->scale(glm::vec3(scale_f));
         }
     }
-    // load materials
-    std::vector<Material> materials;
-    for (uint32_t i = 0; i < scene_ai->mNumMaterials; ++i) {
-        aiString name_ai;
-        scene_ai->mMaterials[i]->Get(AI_MATKEY_NAME, name_ai);
-        materials.push_back(Material(base_name + "_" + name_ai.C_Str(), path.parent_path(), scene_ai->mMaterials[i]));
-    }
-    // link geometry <-> material
-    std::vector<std::pair<Geometry, Material>> result;
-    for (uint32_t i = 0; i < scene_ai->mNumMeshes; ++i)
-        result.push_back(std::make_pair(geometries[i], materials[scene_ai->mMeshes[i]->mMaterialIndex]));
     return result;
 }
 
-std::vector<Mesh> load_meshes_gpu(const fs::path& path, bool normalize) {
+std::vector<Mesh> load_meshes_gpu(const fs::path& path, bool normalize, bool optimize) {
     // build meshes from cpu data
     std::vector<Mesh> meshes;
-    for (const auto& [geometry, material] : load_meshes_cpu(path, normalize))
+    for (const auto& [geometry, material] : load_meshes_cpu(path, normalize, optimize))
         meshes.push_back(Mesh(geometry->name + "/" + material->name, geometry, material));
     return meshes;
 }
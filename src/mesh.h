@@ -9,11 +9,23 @@ namespace fs = std::filesystem;
 #include <GL/gl.h>
 #include <glm/glm.hpp>
 #include "buffer.h"
+#include "geometry_arena.h"
+#include "vertex_format.h"
 #include "geometry.h"
 #include "material.h"
+#include "camera.h"
 
 CPPGL_NAMESPACE_BEGIN
 
+// ------------------------------------------
+// Mesh level of detail (range in the index buffer)
+
+struct MeshLod {
+    uint32_t first_index;
+    uint32_t num_indices;
+    float error; // object space, see GeometryLod
+};
+
 // ------------------------------------------
 // Mesh
 
@@ -28,15 +40,19 @@ public:
     MeshImpl& operator=(const MeshImpl&&) = delete;
 
     void clear_gpu(); // free gpu resources
-    void upload_gpu(); // cpu -> gpu transfer
+    void upload_gpu(); // cpu -> gpu transfer in vertex_format (into the shared geometry arena if use_geometry_arena is set)
 
     // call in this order to draw
     void bind(const Shader& shader) const;
-    void draw() const;
+    void draw(uint32_t lod = 0) const;
     void unbind() const;
 
+    // coarsest level of detail whose projected error stays below threshold (as fraction of the viewport height)
+    uint32_t select_lod(const glm::mat4& model, const Camera& cam, float threshold) const;
+
     // GL vertex and index buffer operations
     uint32_t add_vertex_buffer(GLenum type, uint32_t element_dim, uint32_t num_vertices, const void* data, GLenum hint = GL_STATIC_DRAW);
+    uint32_t add_vertex_stream(const VertexStream& stream, uint32_t num_vertices, const void* data, GLenum hint = GL_STATIC_DRAW); // explicit (e.g. interleaved) layout
     void add_index_buffer(uint32_t num_indices, const uint32_t* data, GLenum hint = GL_STATIC_DRAW);
     void update_vertex_buffer(uint32_t buf_id, const void* data); // assumes matching size for buffer buf_id from add_vertex_buffer()
     void set_primitive_type(GLenum type); // default: GL_TRIANGLES
@@ -47,6 +63,14 @@ public:
     void* map_ibo(GLenum access = GL_READ_WRITE) const;
     void unmap_ibo() const;
 
+    // vertex array to bind for drawing (shared between all meshes of the same arena)
+    inline GLuint vertex_array() const { return arena ? arena->vao : vao; }
+
+    // opt-in: store geometry of subsequently uploaded meshes in shared arenas instead of per-mesh buffers (default: false)
+    static bool use_geometry_arena;
+    // vertex format for subsequently created meshes (default: VertexFormat::separate())
+    static VertexFormat default_vertex_format;
+
     // CPU data
     const std::string name;
     Geometry geometry;
@@ -57,17 +81,25 @@ public:
     uint32_t num_vertices;
     uint32_t num_indices;
     std::vector<VBO> vbos;
-    std::vector<GLenum> vbo_types;
+    std::vector<GLenum> vbo_types; // GL_UNSIGNED_BYTE for buffers with explicit layout (dim is the stride then)
     std::vector<uint32_t> vbo_dims;
     GLenum primitive_type;
+    VertexFormat vertex_format; // encoding used by upload_gpu()
+    glm::mat4 position_decode; // encoded -> object space positions, applied to the model matrix when drawing
+    GeometryArena arena; // only set if stored in a geometry arena, vbos and ibo are empty then
+    ArenaAllocation allocation;
+    std::vector<MeshLod> lods; // uploaded from geometry->lods, lods[0] is full detail (empty if not indexed)
+    glm::vec3 bb_min, bb_max; // object space AABB of the uploaded geometry
 };
 
 using Mesh = NamedHandle<MeshImpl>;
 
 // ------------------------------------------
 // Mesh loader (Ass-Imp)
+// Note: uses the binary mesh cache if a cache directory is set (see mesh_cache.h)
+// optimize: run GeometryImpl::optimize() on all geometries (vertex welding, cache and overdraw ordering), results are cached
 
-std::vector<std::pair<Geometry, Material>> load_meshes_cpu(const fs::path& path, bool normalize = false);
-std::vector<Mesh> load_meshes_gpu(const fs::path& path, bool normalize = false);
+std::vector<std::pair<Geometry, Material>> load_meshes_cpu(const fs::path& path, bool normalize = false, bool optimize = false);
+std::vector<Mesh> load_meshes_gpu(const fs::path& path, bool normalize = false, bool optimize = false);
 
 CPPGL_NAMESPACE_END
@@ -0,0 +1,368 @@
+#include "mesh_cache.h"
+#include <map>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+CPPGL_NAMESPACE_BEGIN
+
+// cache file layout: [header + metadata] [page-aligned data sections...], native endianness
+static const char MESH_CACHE_MAGIC[8] = { 'C', 'P', 'P', 'G', 'L', 'M', 'C', '\0' };
+static const uint32_t MESH_CACHE_VERSION = 2;
+static const uint64_t MESH_CACHE_ALIGNMENT = 4096;
+
+static fs::path cache_dir;
+
+// ------------------------------------------
+// helper funcs
+
+static inline uint64_t align_up(uint64_t offset) {
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+static fs::path cache_file_path(const std::string& source) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)std::hash<std::string>()(source));
+    return cache_dir / (std::string(hex) + ".cppglmesh");
+}
+
+static int64_t source_timestamp(const fs::path& path) {
+    return int64_t(fs::last_write_time(path).time_since_epoch().count());
+}
+
+// read-only memory mapping of a whole file
+struct MappedFile {
+    MappedFile(const fs::path& path) : data(0), size(0) {
+#ifdef _WIN32
+        file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file, &file_size);
+        mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (!mapping) return;
+        data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data) size = size_t(file_size.QuadPart);
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) return;
+        void* ptr = mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) return;
+        madvise(ptr, size_t(st.st_size), MADV_SEQUENTIAL);
+        data = (const uint8_t*)ptr;
+        size = size_t(st.st_size);
+#endif
+    }
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void*)data, size);
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = 0;
+#else
+    int fd = -1;
+#endif
+};
+
+// serialize POD values and strings into a byte buffer
+struct BinaryWriter {
+    template <typename T> void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "BinaryWriter: type must be trivially copyable!");
+        const uint8_t* ptr = (const uint8_t*)&value;
+        buf.insert(buf.end(), ptr, ptr + sizeof(T));
+    }
+    void put_bytes(const void* data, size_t size_bytes) {
+        put(uint64_t(size_bytes));
+        buf.insert(buf.end(), (const uint8_t*)data, (const uint8_t*)data + size_bytes);
+    }
+    void put_string(const std::string& str) {
+        put_bytes(str.data(), str.size());
+    }
+
+    std::vector<uint8_t> buf;
+};
+
+// deserialize POD values and strings from mapped memory (with bounds checking)
+struct BinaryReader {
+    BinaryReader(const uint8_t* data, size_t size) : data(data), size(size), pos(0) {}
+
+    template <typename T> T get() {
+        static_assert(std::is_trivially_copyable<T>::value, "BinaryReader: type must be trivially copyable!");
+        T value;
+        std::memcpy(&value, advance(sizeof(T)), sizeof(T));
+        return value;
+    }
+    std::vector<uint8_t> get_bytes() {
+        const uint64_t size_bytes = get<uint64_t>();
+        const uint8_t* ptr = advance(size_bytes);
+        return std::vector<uint8_t>(ptr, ptr + size_bytes);
+    }
+    std::string get_string() {
+        const uint64_t size_bytes = get<uint64_t>();
+        return std::string((const char*)advance(size_bytes), size_t(size_bytes));
+    }
+    const uint8_t* advance(uint64_t size_bytes) {
+        if (size_bytes > size - pos)
+            throw std::runtime_error("MeshCache: unexpected end of file!");
+        const uint8_t* ptr = data + pos;
+        pos += size_t(size_bytes);
+        return ptr;
+    }
+
+    const uint8_t* data;
+    const size_t size;
+    size_t pos;
+};
+
+// bulk data section (offset relative to the start of the data sections)
+struct Section {
+    uint64_t offset, count;
+};
+
+template <typename T> static void read_section(const MappedFile& file, uint64_t data_start, const Section& section, std::vector<T>& out) {
+    const uint64_t begin = data_start + section.offset, size_bytes = section.count * sizeof(T);
+    if (section.count > file.size / sizeof(T) || begin > file.size || size_bytes > file.size - begin)
+        throw std::runtime_error("MeshCache: data section out of bounds!");
+    out.resize(size_t(section.count));
+    if (size_bytes > 0)
+        std::memcpy(out.data(), file.data + begin, size_t(size_bytes));
+}
+
+// ------------------------------------------
+// Binary mesh cache
+
+void mesh_cache_set_directory(const fs::path& dir) {
+    cache_dir = dir;
+}
+
+fs::path mesh_cache_directory() {
+    return cache_dir;
+}
+
+bool mesh_cache_load(const fs::path& path, uint64_t flags, std::vector<std::pair<Geometry, Material>>& result) {
+    if (cache_dir.empty()) return false;
+    try {
+        const std::string source = fs::absolute(path).lexically_normal().string();
+        const fs::path cache_path = cache_file_path(source);
+        if (!fs::exists(cache_path)) return false;
+        const MappedFile file(cache_path);
+        if (!file.data)
+            throw std::runtime_error("MeshCache: failed to map file: " + cache_path.string());
+        BinaryReader reader(file.data, file.size);
+
+        // check header and key
+        if (std::memcmp(reader.advance(sizeof(MESH_CACHE_MAGIC)), MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0)
+            throw std::runtime_error("MeshCache: invalid file: " + cache_path.string());
+        if (reader.get<uint32_t>() != MESH_CACHE_VERSION) return false;
+        if (reader.get<uint64_t>() != flags) return false;
+        if (reader.get<int64_t>() != source_timestamp(path)) return false;
+        if (reader.get_string() != source) return false;
+        const uint64_t data_start = reader.get<uint64_t>();
+
+        std::cout << "Loading (cached): " << path << "..." << std::endl;
+
+        // materials
+        struct TextureFile { Material mat; std::string key, name; fs::path path; };
+        std::vector<TextureFile> texture_files;
+        std::vector<Material> materials(reader.get<uint32_t>());
+        for (auto& mat : materials) {
+            mat = Material(reader.get_string());
+            for (uint32_t i = 0, n = reader.get<uint32_t>(); i < n; ++i) {
+                const std::string key = reader.get_string();
+                mat->int_map[key] = reader.get<int>();
+            }
+            for (uint32_t i = 0, n = reader.get<uint32_t>(); i < n; ++i) {
+                const std::string key = reader.get_string();
+                mat->float_map[key] = reader.get<float>();
+            }
+            for (uint32_t i = 0, n = reader.get<uint32_t>(); i < n; ++i) {
+                const std::string key = reader.get_string();
+                mat->vec2_map[key] = reader.get<glm::vec2>();
+            }
+            for (uint32_t i = 0, n = reader.get<uint32_t>(); i < n; ++i) {
+                const std::string key = reader.get_string();
+                mat->vec3_map[key] = reader.get<glm::vec3>();
+            }
+            for (uint32_t i = 0, n = reader.get<uint32_t>(); i < n; ++i) {
+                const std::string key = reader.get_string();
+                mat->vec4_map[key] = reader.get<glm::vec4>();
+            }
+            for (uint32_t i = 0, n = reader.get<uint32_t>(); i < n; ++i) {
+                const std::string key = reader.get_string();
+                const std::string tex_name = reader.get_string();
+                if (reader.get<uint8_t>()) { // image file (loaded below)
+                    texture_files.push_back(TextureFile{ mat, key, tex_name, fs::u8path(reader.get_string()) });
+                } else { // raw data (e.g. 1x1 fallback textures)
+                    const uint32_t w = reader.get<uint32_t>(), h = reader.get<uint32_t>();
+                    const GLint internal_format = reader.get<GLint>();
+                    const GLenum format = reader.get<GLenum>(), type = reader.get<GLenum>();
+                    const std::vector<uint8_t> pixels = reader.get_bytes();
+                    mat->add_texture(key, Texture2D(tex_name, w, h, internal_format, format, type, pixels.data()));
+                }
+            }
+        }
+        // decode texture files in parallel, then create GL textures on this thread
+        std::vector<fs::path> texture_paths;
+        for (const auto& file : texture_files)
+            texture_paths.push_back(file.path);
+        const std::map<fs::path, ImageData> images = image_load_parallel(texture_paths);
+        for (auto& file : texture_files) {
+            const auto it = images.find(file.path);
+            file.mat->add_texture(file.key, it != images.end() ? Texture2D(file.name, file.path, it->second) : Texture2D(file.name, file.path));
+        }
+
+        // geometries
+        const uint32_t num_geometries = reader.get<uint32_t>();
+        result.clear();
+        result.reserve(num_geometries);
+        for (uint32_t i = 0; i < num_geometries; ++i) {
+            Geometry geom(reader.get_string());
+            const uint32_t mat_index = reader.get<uint32_t>();
+            if (mat_index >= materials.size())
+                throw std::runtime_error("MeshCache: material index out of range!");
+            geom->bb_min = reader.get<glm::vec3>();
+            geom->bb_max = reader.get<glm::vec3>();
+            read_section(file, data_start, reader.get<Section>(), geom->positions);
+            read_section(file, data_start, reader.get<Section>(), geom->normals);
+            read_section(file, data_start, reader.get<Section>(), geom->texcoords);
+            read_section(file, data_start, reader.get<Section>(), geom->indices);
+            result.push_back(std::make_pair(geom, materials[mat_index]));
+        }
+        return true;
+    } catch (std::exception& e) {
+        std::cerr << "WARN: " << e.what() << " Falling back to " << path << "." << std::endl;
+        result.clear();
+        return false;
+    }
+}
+
+void mesh_cache_store(const fs::path& path, uint64_t flags, const std::vector<std::pair<Geometry, Material>>& data) {
+    if (cache_dir.empty()) return;
+    try {
+        const std::string source = fs::absolute(path).lexically_normal().string();
+        const fs::path cache_path = cache_file_path(source);
+
+        // collect unique materials
+        std::vector<Material> materials;
+        std::map<const MaterialImpl*, uint32_t> material_index;
+        for (const auto& [geom, mat] : data) {
+            if (material_index.count(mat.ptr.get())) continue;
+            material_index[mat.ptr.get()] = uint32_t(materials.size());
+            materials.push_back(mat);
+        }
+
+        // metadata
+        BinaryWriter meta;
+        meta.put(uint32_t(materials.size()));
+        for (const auto& mat : materials) {
+            meta.put_string(mat->name);
+            meta.put(uint32_t(mat->int_map.size()));
+            for (const auto& [key, value] : mat->int_map) { meta.put_string(key); meta.put(value); }
+            meta.put(uint32_t(mat->float_map.size()));
+            for (const auto& [key, value] : mat->float_map) { meta.put_string(key); meta.put(value); }
+            meta.put(uint32_t(mat->vec2_map.size()));
+            for (const auto& [key, value] : mat->vec2_map) { meta.put_string(key); meta.put(value); }
+            meta.put(uint32_t(mat->vec3_map.size()));
+            for (const auto& [key, value] : mat->vec3_map) { meta.put_string(key); meta.put(value); }
+            meta.put(uint32_t(mat->vec4_map.size()));
+            for (const auto& [key, value] : mat->vec4_map) { meta.put_string(key); meta.put(value); }
+            meta.put(uint32_t(mat->texture_map.size()));
+            for (const auto& [key, tex] : mat->texture_map) {
+                meta.put_string(key);
+                meta.put_string(tex->name);
+                const bool from_file = !tex->loaded_from_path.empty();
+                meta.put(uint8_t(from_file));
+                if (from_file)
+                    meta.put_string(fs::absolute(tex->loaded_from_path).u8string());
+                else {
+                    // read back raw texture data
+                    std::vector<uint8_t> pixels(size_t(tex->w) * tex->h * format_to_channels(tex->format) * GLenum_to_typesize(tex->type));
+                    GLState::bind_texture(GL_TEXTURE_2D, tex->id);
+                    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                    glGetTexImage(GL_TEXTURE_2D, 0, tex->format, tex->type, pixels.data());
+                    GLState::bind_texture(GL_TEXTURE_2D, 0);
+                    meta.put(uint32_t(tex->w));
+                    meta.put(uint32_t(tex->h));
+                    meta.put(tex->internal_format);
+                    meta.put(tex->format);
+                    meta.put(tex->type);
+                    meta.put_bytes(pixels.data(), pixels.size());
+                }
+            }
+        }
+        std::vector<std::pair<const void*, uint64_t>> sections;
+        uint64_t data_size = 0;
+        const auto add_section = [&](const void* ptr, uint64_t count, uint64_t element_size) {
+            meta.put(Section{ data_size, count });
+            sections.push_back(std::make_pair(ptr, count * element_size));
+            data_size = align_up(data_size + count * element_size);
+        };
+        meta.put(uint32_t(data.size()));
+        for (const auto& [geom, mat] : data) {
+            meta.put_string(geom->name);
+            meta.put(material_index[mat.ptr.get()]);
+            meta.put(geom->bb_min);
+            meta.put(geom->bb_max);
+            add_section(geom->positions.data(), geom->positions.size(), sizeof(glm::vec3));
+            add_section(geom->normals.data(), geom->normals.size(), sizeof(glm::vec3));
+            add_section(geom->texcoords.data(), geom->texcoords.size(), sizeof(glm::vec2));
+            add_section(geom->indices.data(), geom->indices.size(), sizeof(uint32_t));
+        }
+
+        // header
+        BinaryWriter header;
+        header.buf.insert(header.buf.end(), MESH_CACHE_MAGIC, MESH_CACHE_MAGIC + sizeof(MESH_CACHE_MAGIC));
+        header.put(MESH_CACHE_VERSION);
+        header.put(flags);
+        header.put(source_timestamp(path));
+        header.put_string(source);
+        const uint64_t data_start = align_up(header.buf.size() + sizeof(uint64_t) + meta.buf.size());
+        header.put(data_start);
+
+        // write to temporary file first, then move into place
+        fs::create_directories(cache_dir);
+        const fs::path tmp_path = fs::path(cache_path).concat(".tmp");
+        {
+            std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+                throw std::runtime_error("MeshCache: failed to open file for writing: " + tmp_path.string());
+            const std::vector<char> padding(MESH_CACHE_ALIGNMENT, 0);
+            file.write((const char*)header.buf.data(), header.buf.size());
+            file.write((const char*)meta.buf.data(), meta.buf.size());
+            file.write(padding.data(), data_start - header.buf.size() - meta.buf.size());
+            for (const auto& [ptr, size_bytes] : sections) {
+                file.write((const char*)ptr, size_bytes);
+                file.write(padding.data(), align_up(size_bytes) - size_bytes);
+            }
+            if (!file.good())
+                throw std::runtime_error("MeshCache: failed to write file: " + tmp_path.string());
+        }
+        fs::rename(tmp_path, cache_path);
+    } catch (std::exception& e) {
+        std::cerr << "WARN: failed to store mesh cache for " << path << ": " << e.what() << std::endl;
+    }
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <filesystem>
+namespace fs = std::filesystem;
+#include "geometry.h"
+#include "material.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Binary mesh cache
+// Stores everything load_meshes_cpu() extracts from a scene file (vertex data, indices, AABBs, material parameters
+// and texture references) in a versioned binary file, so warm starts can skip Assimp entirely.
+// Bulk data sections are page-aligned, cache files are memory-mapped on load.
+// Entries are keyed by source path, source modification time and flags, stale entries are rebuilt.
+// Flags: Assimp import flags in the lower 32 bits, cppgl post-processing options in the upper 32 bits.
+
+static const uint64_t MESH_CACHE_OPTIMIZED = uint64_t(1) << 32; // geometries were run through GeometryImpl::optimize()
+
+// set directory to store cache files in (empty path disables the cache, which is the default)
+void mesh_cache_set_directory(const fs::path& dir);
+fs::path mesh_cache_directory();
+
+// load cached data for given source file (returns false on cache miss or invalid entry)
+bool mesh_cache_load(const fs::path& path, uint64_t flags, std::vector<std::pair<Geometry, Material>>& result);
+// store data for given source file (silently does nothing if the cache is disabled)
+void mesh_cache_store(const fs::path& path, uint64_t flags, const std::vector<std::pair<Geometry, Material>>& data);
+
+CPPGL_NAMESPACE_END
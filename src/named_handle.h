@@ -1,13 +1,18 @@
 #pragma once
 
-#include <map>
 #include <mutex>
 #include <memory>
 #include <string>
+#include <vector>
+#include <atomic>
 #include <cassert>
 #include <iostream>
+#include <utility>
+#include <algorithm>
 #include <stdexcept>
 #include <type_traits>
+#include <shared_mutex>
+#include <unordered_map>
 #include "platform.h"
 
 CPPGL_NAMESPACE_BEGIN
@@ -15,6 +20,154 @@ CPPGL_NAMESPACE_BEGIN
 template <typename T, typename = int> struct HasName : std::false_type {};
 template <typename T> struct HasName <T, decltype((void) T::name, 0)> : std::true_type {};
 
+// ------------------------------------------
+// Registry backend of NamedHandle
+// Hashed and sharded, lookups only take a shared lock on one shard and writers only block their shard.
+// Iteration runs over an immutable snapshot sorted by name, taken on begin() and cached until the next modification,
+// so it is safe against concurrent inserts/erases (which are simply not reflected in a running iteration).
+
+template <typename H> class NamedHandleRegistry {
+public:
+    using value_type = std::pair<std::string, H>;
+    using Snapshot = std::vector<value_type>;
+
+    class iterator {
+    public:
+        iterator() : idx(0) {}
+        iterator(const std::shared_ptr<Snapshot>& snap, size_t idx) : snap(snap), idx(idx) {}
+
+        inline value_type& operator*() const { return (*snap)[idx]; }
+        inline value_type* operator->() const { return &(*snap)[idx]; }
+        inline iterator& operator++() { ++idx; return *this; }
+        inline bool operator==(const iterator& other) const {
+            return at_end() == other.at_end() && (at_end() || (snap == other.snap && idx == other.idx));
+        }
+        inline bool operator!=(const iterator& other) const { return !(*this == other); }
+
+    private:
+        inline bool at_end() const { return !snap || idx >= snap->size(); }
+        std::shared_ptr<Snapshot> snap; // keeps the snapshot alive while iterating
+        size_t idx;
+    };
+
+    // insert or replace, returns false if the name was already taken
+    bool insert(const std::string& name, const H& handle) {
+        H replaced; // release outside of the lock
+        bool inserted = false;
+        {
+            Shard& s = shard(name);
+            const std::unique_lock<std::shared_mutex> lock(s.mutex);
+            auto it = s.entries.find(name);
+            if (it != s.entries.end())
+                replaced = std::exchange(it->second, handle);
+            else {
+                s.entries.emplace(name, handle);
+                num_entries++;
+                inserted = true;
+            }
+            version++;
+        }
+        if (!inserted) drop_snapshot();
+        return inserted;
+    }
+
+    size_t count(const std::string& name) const {
+        const Shard& s = shard(name);
+        const std::shared_lock<std::shared_mutex> lock(s.mutex);
+        return s.entries.count(name);
+    }
+
+    // throws std::out_of_range if not present
+    H at(const std::string& name) const {
+        const Shard& s = shard(name);
+        const std::shared_lock<std::shared_mutex> lock(s.mutex);
+        return s.entries.at(name);
+    }
+
+    void erase(const std::string& name) {
+        H erased; // release outside of the lock
+        {
+            Shard& s = shard(name);
+            const std::unique_lock<std::shared_mutex> lock(s.mutex);
+            auto it = s.entries.find(name);
+            if (it == s.entries.end()) return;
+            erased = std::move(it->second);
+            s.entries.erase(it);
+            num_entries--;
+            version++;
+        }
+        drop_snapshot();
+    }
+
+    void clear() {
+        for (auto& s : shards) {
+            std::unordered_map<std::string, H> erased; // release outside of the lock
+            const std::unique_lock<std::shared_mutex> lock(s.mutex);
+            erased.swap(s.entries);
+            num_entries -= erased.size();
+            version++;
+        }
+        drop_snapshot();
+    }
+
+    inline size_t size() const { return num_entries; }
+    inline bool empty() const { return num_entries == 0; }
+
+    // consistent copy of all entries (sorted by name)
+    std::shared_ptr<Snapshot> snapshot() const {
+        std::shared_ptr<Snapshot> outdated; // release outside of the lock
+        const std::lock_guard<std::mutex> lock(snapshot_mutex);
+        if (cached && cached_version == version) return cached;
+        auto snap = std::make_shared<Snapshot>();
+        {
+            std::shared_lock<std::shared_mutex> locks[NUM_SHARDS];
+            for (size_t i = 0; i < NUM_SHARDS; ++i)
+                locks[i] = std::shared_lock<std::shared_mutex>(shards[i].mutex);
+            snap->reserve(num_entries);
+            for (const auto& s : shards)
+                snap->insert(snap->end(), s.entries.begin(), s.entries.end());
+            cached_version = version;
+        }
+        std::sort(snap->begin(), snap->end(), [](const value_type& a, const value_type& b) { return a.first < b.first; });
+        outdated = std::move(cached);
+        cached = snap;
+        return cached;
+    }
+
+    // iterate over a snapshot
+    inline iterator begin() const { return iterator(snapshot(), 0); }
+    inline iterator end() const { return iterator(); }
+
+private:
+    static const size_t NUM_SHARDS = 16;
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, H> entries;
+    };
+
+    // cached snapshots keep erased handles alive, so drop it (never call with a shard lock held)
+    void drop_snapshot() const {
+        std::shared_ptr<Snapshot> dropped;
+        const std::lock_guard<std::mutex> lock(snapshot_mutex);
+        dropped.swap(cached);
+    }
+
+    inline Shard& shard(const std::string& name) { return shards[std::hash<std::string>()(name) % NUM_SHARDS]; }
+    inline const Shard& shard(const std::string& name) const { return shards[std::hash<std::string>()(name) % NUM_SHARDS]; }
+
+    // data
+    Shard shards[NUM_SHARDS];
+    std::atomic<size_t> num_entries{0};
+    std::atomic<uint64_t> version{0};
+    mutable std::mutex snapshot_mutex;
+    mutable std::shared_ptr<Snapshot> cached;
+    mutable uint64_t cached_version = 0;
+};
+
+// ------------------------------------------
+// NamedHandle (shared pointer with global name registry per type)
+
 template <typename T> class NamedHandle {
 public:
     // "default" construct
@@ -24,11 +177,11 @@ public:
     template <class... Args> NamedHandle(const std::string& name, Args&&... args) : ptr(std::make_shared<T>(name, args...)) {
         static_assert(HasName<T>::value, "Template type T is required to have a member \"name\"!");
         static_assert(std::is_same<decltype(T::name), std::string>::value || std::is_same<decltype(T::name), const std::string>::value, "bad type bro");
+        const bool unique = map.insert(ptr->name, *this);
 #ifndef NDEBUG
-        if (map.count(ptr->name)) std::cerr << "Warning: Name \"" << ptr->name << "\" is not unique!" << std::endl;
+        if (!unique) std::cerr << "Warning: Name \"" << ptr->name << "\" is not unique!" << std::endl;
 #endif
-        const std::lock_guard<std::mutex> lock(mutex);
-        map[ptr->name] = *this;
+        (void)unique;
     }
 
     virtual ~NamedHandle() {}
@@ -48,36 +201,30 @@ public:
 
     // check if mapping for given name exists
     static bool valid(const std::string& name) {
-        const std::lock_guard<std::mutex> lock(mutex);
         return map.count(name);
     }
     // return mapped handle for given name
     static NamedHandle<T> find(const std::string& name) {
-        const std::lock_guard<std::mutex> lock(mutex);
         return map.at(name);
     }
     // remove element from map for given name
     static void erase(const std::string& name) {
-        const std::lock_guard<std::mutex> lock(mutex);
         map.erase(name);
     }
     // clear saved handles and free unsused memory
     static void clear() {
-        const std::lock_guard<std::mutex> lock(mutex);
         map.clear();
     }
 
-    // iterators to iterate over all entries
-    static typename std::map<std::string, NamedHandle<T>>::iterator begin() { return map.begin(); }
-    static typename std::map<std::string, NamedHandle<T>>::iterator end() { return map.end(); }
+    // iterators to iterate over all entries (on a snapshot, see NamedHandleRegistry)
+    static typename NamedHandleRegistry<NamedHandle<T>>::iterator begin() { return map.begin(); }
+    static typename NamedHandleRegistry<NamedHandle<T>>::iterator end() { return map.end(); }
 
     std::shared_ptr<T> ptr;
-    static std::mutex mutex;
-    static std::map<std::string, NamedHandle<T>> map;
+    static NamedHandleRegistry<NamedHandle<T>> map;
 };
 
 // definition of static members (compiler magic)
-template <typename T> std::mutex NamedHandle<T>::mutex;
-template <typename T> std::map<std::string, NamedHandle<T>> NamedHandle<T>::map;
+template <typename T> NamedHandleRegistry<NamedHandle<T>> NamedHandle<T>::map;
 
 CPPGL_NAMESPACE_END
@@ -2,6 +2,7 @@
 
 #include <GL/glew.h>
 #include <GL/gl.h>
+#include "gl_state.h"
 
 CPPGL_NAMESPACE_BEGIN
 
@@ -26,20 +27,20 @@ Quad::Quad() {
     static float quad[20] = {0, 0, 1, 0, 0, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1};
     static uint32_t idx[6] = {0, 1, 2, 2, 3, 0};
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    GLState::bind_vertex_array(vao);
     glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLState::bind_buffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
     glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    GLState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(idx), idx, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 5, 0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 5, (GLvoid*)(sizeof(float)*3));
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    GLState::bind_vertex_array(0);
+    GLState::bind_buffer(GL_ARRAY_BUFFER, 0);
+    GLState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 Quad::~Quad() {
@@ -54,9 +55,9 @@ void Quad::draw() {
 }
 
 void Quad::draw_internal() const {
-    glBindVertexArray(vao);
+    GLState::bind_vertex_array(vao);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    GLState::bind_vertex_array(0);
 }
 
 CPPGL_NAMESPACE_END
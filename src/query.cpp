@@ -1,4 +1,5 @@
 #include "query.h"
+#include "deletion_queue.h"
 
 CPPGL_NAMESPACE_BEGIN
 
@@ -17,6 +18,21 @@ void TimerQueryImpl::end() {
     put(float(timer.look()));
 }
 
+// -------------------------------------------------------
+// (CPU) CounterQuery
+
+CounterQueryImpl::CounterQueryImpl(const std::string& name, size_t samples) : Query(name, samples), count(0) {}
+
+CounterQueryImpl::~CounterQueryImpl() {}
+
+void CounterQueryImpl::begin() {
+    count = 0;
+}
+
+void CounterQueryImpl::end() {
+    put(float(count));
+}
+
 // -------------------------------------------------------
 // (GPU) TimerQueryGL (in ms)
 
@@ -28,8 +44,8 @@ TimerQueryGLImpl::TimerQueryGLImpl(const std::string& name, size_t samples) : Qu
 }
 
 TimerQueryGLImpl::~TimerQueryGLImpl() {
-    glDeleteQueries(2, query_ids[0]);
-    glDeleteQueries(2, query_ids[1]);
+    for (uint32_t i = 0; i < 4; ++i)
+        gl_delete_deferred(GLObject::QUERY, query_ids[i / 2][i % 2]);
 }
 
 void TimerQueryGLImpl::begin() {
@@ -57,7 +73,8 @@ PrimitiveQueryGLImpl::PrimitiveQueryGLImpl(const std::string& name, size_t sampl
 }
 
 PrimitiveQueryGLImpl::~PrimitiveQueryGLImpl() {
-    glDeleteQueries(2, query_ids);
+    gl_delete_deferred(GLObject::QUERY, query_ids[0]);
+    gl_delete_deferred(GLObject::QUERY, query_ids[1]);
 }
 
 void PrimitiveQueryGLImpl::begin() {
@@ -85,7 +102,8 @@ FragmentQueryGLImpl::FragmentQueryGLImpl(const std::string& name, size_t samples
 }
 
 FragmentQueryGLImpl::~FragmentQueryGLImpl() {
-    glDeleteQueries(2, query_ids);
+    gl_delete_deferred(GLObject::QUERY, query_ids[0]);
+    gl_delete_deferred(GLObject::QUERY, query_ids[1]);
 }
 
 void FragmentQueryGLImpl::begin() {
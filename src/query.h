@@ -97,6 +97,25 @@ public:
 
 using TimerQuery = NamedHandle<TimerQueryImpl>;
 
+// -------------------------------------------------------
+// (CPU) CounterQuery (counts events between begin and end)
+
+class CounterQueryImpl : public Query {
+public:
+    CounterQueryImpl(const std::string& name, size_t samples = 256);
+    virtual ~CounterQueryImpl();
+
+    void begin();
+    void end();
+
+    inline void add(uint32_t n = 1) { count += n; }
+
+    // data
+    uint32_t count;
+};
+
+using CounterQuery = NamedHandle<CounterQueryImpl>;
+
 // -------------------------------------------------------
 // (GPU) TimerQueryGL (in ms)
 
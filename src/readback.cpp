@@ -0,0 +1,134 @@
+#include "readback.h"
+#include <deque>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include "buffer.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// state
+
+struct ReadbackJob {
+    PPBO pbo;
+    size_t size;
+    GLsync fence;
+    std::promise<std::vector<uint8_t>> promise;
+    ReadbackCallback callback;
+};
+
+static std::deque<ReadbackJob> jobs; // in submission order
+static std::vector<PPBO> pool; // idle buffers
+
+// ------------------------------------------
+// helper funcs
+
+// reuse an idle buffer of sufficient size, else grow or create one
+static PPBO acquire_buffer(size_t size_bytes) {
+    static uint32_t counter = 0;
+    PPBO pbo;
+    for (auto it = pool.begin(); it != pool.end(); ++it) {
+        if ((*it)->size_bytes >= size_bytes) {
+            pbo = *it;
+            pool.erase(it);
+            return pbo;
+        }
+    }
+    if (!pool.empty()) {
+        pbo = pool.back();
+        pool.pop_back();
+    } else
+        pbo = PPBO("readback_ppbo_" + std::to_string(counter++));
+    pbo->resize(size_bytes, GL_STREAM_READ);
+    return pbo;
+}
+
+static std::future<std::vector<uint8_t>> submit(const PPBO& pbo, size_t size_bytes, const ReadbackCallback& callback) {
+    jobs.push_back(ReadbackJob{ pbo, size_bytes, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), std::promise<std::vector<uint8_t>>(), callback });
+    return jobs.back().promise.get_future();
+}
+
+static void fulfill(ReadbackJob& job) {
+    std::vector<uint8_t> data(job.size);
+    if (job.size > 0) {
+        const void* ptr = job.pbo->map_range(0, job.size, GL_MAP_READ_BIT);
+        if (ptr) std::memcpy(data.data(), ptr, job.size);
+        job.pbo->unmap();
+    }
+    glDeleteSync(job.fence);
+    pool.push_back(job.pbo);
+    if (job.callback)
+        job.callback(data);
+    job.promise.set_value(std::move(data));
+}
+
+// ------------------------------------------
+// Asynchronous readback
+
+std::future<std::vector<uint8_t>> readback_texture_async(const Texture2DImpl& tex, GLenum format, GLenum type, int level, const ReadbackCallback& callback) {
+    const int w = std::max(1, tex.w >> level), h = std::max(1, tex.h >> level);
+    const size_t size_bytes = size_t(w) * h * format_to_channels(format) * GLenum_to_typesize(type);
+    PPBO pbo = acquire_buffer(size_bytes);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    pbo->bind();
+    if (GLState::dsa)
+        glGetTextureImage(tex.id, level, format, type, GLsizei(size_bytes), 0);
+    else {
+        GLState::bind_texture(GL_TEXTURE_2D, tex.id);
+        glGetTexImage(GL_TEXTURE_2D, level, format, type, 0);
+        GLState::bind_texture(GL_TEXTURE_2D, 0);
+    }
+    pbo->unbind();
+    return submit(pbo, size_bytes, callback);
+}
+
+std::future<std::vector<uint8_t>> readback_framebuffer_async(int x, int y, int w, int h, GLenum format, GLenum type, const ReadbackCallback& callback) {
+    const size_t size_bytes = size_t(w) * h * format_to_channels(format) * GLenum_to_typesize(type);
+    PPBO pbo = acquire_buffer(size_bytes);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    pbo->bind();
+    glReadPixels(x, y, w, h, format, type, 0);
+    pbo->unbind();
+    return submit(pbo, size_bytes, callback);
+}
+
+std::future<std::vector<uint8_t>> readback_buffer_async(GLuint buffer, size_t offset_bytes, size_t size_bytes, const ReadbackCallback& callback) {
+    PPBO pbo = acquire_buffer(size_bytes);
+    if (GLState::dsa)
+        glCopyNamedBufferSubData(buffer, pbo->id, offset_bytes, 0, size_bytes);
+    else {
+        GLState::bind_buffer(GL_COPY_READ_BUFFER, buffer);
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, pbo->id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset_bytes, 0, size_bytes);
+        GLState::bind_buffer(GL_COPY_READ_BUFFER, 0);
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    return submit(pbo, size_bytes, callback);
+}
+
+void readback_update() {
+    // fences are signaled in order, so stop at the first one still pending
+    while (!jobs.empty()) {
+        const GLenum status = glClientWaitSync(jobs.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        fulfill(jobs.front());
+        jobs.pop_front();
+    }
+}
+
+void readback_flush() {
+    while (!jobs.empty()) {
+        GLenum status = glClientWaitSync(jobs.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(jobs.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+        fulfill(jobs.front());
+        jobs.pop_front();
+    }
+}
+
+size_t readback_pending() {
+    return jobs.size();
+}
+
+CPPGL_NAMESPACE_END
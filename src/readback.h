@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <future>
+#include <functional>
+#include "texture.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Asynchronous GPU -> CPU readback
+// Reads are copied into a pool of pixel pack buffers on the GPU and fenced, the returned future is fulfilled
+// by readback_update() once the fence has passed (usually a few frames later), so no call stalls the pipeline.
+// The optional callback is invoked with the data on the context thread right before the future is fulfilled.
+// Note: all functions have to be called from the context thread and waiting on a future there never returns
+// without readback_flush(), so consume results from worker threads or poll them with wait_for(0).
+
+using ReadbackCallback = std::function<void(const std::vector<uint8_t>&)>;
+
+// read given mip level of a texture (tightly packed, size: w * h * channels(format) * sizeof(type))
+std::future<std::vector<uint8_t>> readback_texture_async(const Texture2DImpl& tex, GLenum format, GLenum type, int level = 0,
+        const ReadbackCallback& callback = ReadbackCallback());
+inline std::future<std::vector<uint8_t>> readback_texture_async(const Texture2D& tex, GLenum format, GLenum type, int level = 0,
+        const ReadbackCallback& callback = ReadbackCallback()) {
+    return readback_texture_async(*tex, format, type, level, callback);
+}
+// read region of the currently bound read framebuffer (tightly packed, like glReadPixels)
+std::future<std::vector<uint8_t>> readback_framebuffer_async(int x, int y, int w, int h, GLenum format, GLenum type,
+        const ReadbackCallback& callback = ReadbackCallback());
+// read byte range of a GL buffer (any target)
+std::future<std::vector<uint8_t>> readback_buffer_async(GLuint buffer, size_t offset_bytes, size_t size_bytes,
+        const ReadbackCallback& callback = ReadbackCallback());
+
+// fulfill readbacks whose fence has passed (called once per frame by Context::swap_buffers)
+void readback_update();
+// block until all pending readbacks are fulfilled
+void readback_flush();
+
+// amount of readbacks not yet fulfilled
+size_t readback_pending();
+
+CPPGL_NAMESPACE_END
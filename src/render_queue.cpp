@@ -0,0 +1,144 @@
+#include "render_queue.h"
+#include "camera.h"
+#include "gl_state.h"
+#include "frame_uniforms.h"
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+// ----------------------------------------------------
+// helper funcs
+
+static const uint32_t SHADER_BITS = 12, MATERIAL_BITS = 12, MESH_BITS = 14, DEPTH_BITS = 24;
+
+// id in order of first appearance, saturating at the field width
+static inline uint64_t object_id(std::unordered_map<const void*, uint32_t>& ids, const void* ptr, uint32_t bits) {
+    const uint32_t max_id = (1u << bits) - 1;
+    const auto it = ids.emplace(ptr, std::min(uint32_t(ids.size()), max_id)).first;
+    return it->second;
+}
+
+// LSD radix sort by key (stable), 8 bits per pass, passes where all keys share the digit are skipped
+template <typename T> static void radix_sort(std::vector<T>& items, std::vector<T>& scratch) {
+    scratch.resize(items.size());
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = { 0 };
+        for (const T& item : items)
+            counts[(item.key >> shift) & 0xFF]++;
+        if (counts[(items[0].key >> shift) & 0xFF] == items.size()) continue;
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            const size_t c = count;
+            count = offset;
+            offset += c;
+        }
+        for (const T& item : items)
+            scratch[counts[(item.key >> shift) & 0xFF]++] = item;
+        items.swap(scratch);
+    }
+}
+
+// ----------------------------------------------------
+// RenderQueue
+
+RenderQueueImpl::RenderQueueImpl(const std::string& name)
+    : name(name), num_draws(0), num_shader_changes(0), num_material_changes(0), num_mesh_changes(0) {}
+
+RenderQueueImpl::~RenderQueueImpl() {}
+
+void RenderQueueImpl::add(const Drawelement& elem, RenderPass pass) {
+    drawelements.emplace_back(elem, pass);
+}
+
+void RenderQueueImpl::clear() {
+    drawelements.clear();
+}
+
+uint64_t RenderQueueImpl::sort_key(const DrawelementImpl& elem, RenderPass pass, const glm::mat4& view, float near, float far) {
+    const uint64_t shader = object_id(shader_ids, elem.shader.ptr.get(), SHADER_BITS);
+    const uint64_t material = object_id(material_ids, elem.mesh->material.ptr.get(), MATERIAL_BITS);
+    const uint64_t mesh = object_id(mesh_ids, elem.mesh.ptr.get(), MESH_BITS);
+    const glm::vec4 center = view * elem.model * glm::vec4((elem.mesh->bb_min + elem.mesh->bb_max) * 0.5f, 1.f);
+    const float t = glm::clamp((-center.z - near) / (far - near), 0.f, 1.f);
+    const uint64_t max_depth = (1ull << DEPTH_BITS) - 1;
+    const uint64_t depth = uint64_t(t * float(max_depth));
+    const uint64_t state = (shader << (MATERIAL_BITS + MESH_BITS)) | (material << MESH_BITS) | mesh;
+    if (pass == RenderPass::BLENDED)
+        return (uint64_t(pass) << 62) | ((max_depth - depth) << 38) | state;
+    return (uint64_t(pass) << 62) | (state << DEPTH_BITS) | depth;
+}
+
+void RenderQueueImpl::draw() {
+    num_draws = num_shader_changes = num_material_changes = num_mesh_changes = 0;
+    const Camera cam = current_camera();
+    shader_ids.clear();
+    material_ids.clear();
+    mesh_ids.clear();
+    items.clear();
+    for (uint32_t i = 0; i < drawelements.size(); ++i) {
+        const DrawelementImpl& elem = *drawelements[i].first;
+        if (!elem.shader || !elem.mesh || !elem.shader->ready()) continue;
+        items.push_back(SortItem{ sort_key(elem, drawelements[i].second, cam->view, cam->near, cam->far), i });
+    }
+    if (items.empty()) return;
+    radix_sort(items, scratch);
+
+    // submit in key order, only switching state that actually changed
+    const ShaderImpl* bound_shader = 0;
+    const MaterialImpl* bound_material = 0;
+    const MeshImpl* bound_mesh = 0;
+    RenderPass bound_pass = RenderPass::OPAQUE;
+    for (const SortItem& item : items) {
+        const DrawelementImpl& elem = *drawelements[item.index].first;
+        const RenderPass pass = drawelements[item.index].second;
+        if (pass != bound_pass) {
+            GLState::enable(GL_BLEND);
+            GLState::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            GLState::depth_mask(false);
+            bound_pass = pass;
+        }
+        const ShaderImpl* shader = elem.shader.ptr.get();
+        if (shader != bound_shader) {
+            shader->bind();
+            if (shader->frame_uniforms_block)
+                frame_uniforms_bind();
+            else {
+                shader->uniform("view", cam->view);
+                shader->uniform("view_normal", cam->view_normal);
+                shader->uniform("proj", cam->proj);
+            }
+            bound_shader = shader;
+            if (bound_material) bound_material->unbind();
+            bound_material = 0; // material uniforms are per program
+            num_shader_changes++;
+        }
+        if (elem.mesh.ptr.get() != bound_mesh) {
+            GLState::bind_vertex_array(elem.mesh->vertex_array());
+            bound_mesh = elem.mesh.ptr.get();
+            num_mesh_changes++;
+        }
+        const MaterialImpl* material = elem.mesh->material.ptr.get();
+        if (material != bound_material) {
+            // don't leak textures of the previous material to meshes without one
+            if (bound_material) bound_material->unbind();
+            if (material) {
+                material->bind(elem.shader);
+                num_material_changes++;
+            }
+            bound_material = material;
+        }
+        shader->uniform("model", elem.model * elem.mesh->position_decode);
+        shader->uniform("model_normal", glm::transpose(glm::inverse(elem.model)));
+        elem.mesh->draw(elem.mesh->select_lod(elem.model, cam, DrawelementImpl::lod_threshold));
+        num_draws++;
+    }
+    if (bound_material) bound_material->unbind();
+    if (bound_pass == RenderPass::BLENDED) {
+        GLState::disable(GL_BLEND);
+        GLState::depth_mask(true);
+    }
+    GLState::bind_vertex_array(0);
+    GLState::use_program(0);
+}
+
+CPPGL_NAMESPACE_END
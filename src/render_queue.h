@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "named_handle.h"
+#include "drawelement.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+#undef OPAQUE // windows.h
+
+// ------------------------------------------
+// Render passes, submitted in this order
+
+enum class RenderPass : uint32_t { OPAQUE, BLENDED };
+
+// ------------------------------------------
+// RenderQueue
+// Builds a 64 bit sort key per drawelement and radix sorts them on each draw(), so state changes are minimized
+// and early-Z can reject occluded fragments. Key layout (msb to lsb):
+//  OPAQUE:  pass (2) | shader (12) | material (12) | mesh (14) | depth (24, front to back)
+//  BLENDED: pass (2) | depth (24, back to front) | shader (12) | material (12) | mesh (14)
+// Shader, material and mesh ids are assigned per draw() in order of first appearance (saturating, thus excess
+// objects are only sorted by depth). Depth is the view space distance of the bounding box center, quantized
+// linearly between the current camera's near and far plane.
+// The blended pass is drawn with alpha blending and without depth writes.
+
+class RenderQueueImpl {
+public:
+    RenderQueueImpl(const std::string& name);
+    virtual ~RenderQueueImpl();
+
+    // prevent copies and moves
+    RenderQueueImpl(const RenderQueueImpl&) = delete;
+    RenderQueueImpl& operator=(const RenderQueueImpl&) = delete;
+    RenderQueueImpl& operator=(const RenderQueueImpl&&) = delete;
+
+    // manage drawelements to render
+    void add(const Drawelement& elem, RenderPass pass = RenderPass::OPAQUE);
+    void clear();
+
+    // build keys, sort and draw all drawelements (model matrices are read from the drawelements on each call)
+    void draw();
+
+    // data
+    const std::string name;
+    std::vector<std::pair<Drawelement, RenderPass>> drawelements;
+    uint32_t num_draws; // draw calls issued by the last draw()
+    uint32_t num_shader_changes, num_material_changes, num_mesh_changes; // state switches of the last draw()
+
+private:
+    struct SortItem {
+        uint64_t key;
+        uint32_t index; // into drawelements
+    };
+    uint64_t sort_key(const DrawelementImpl& elem, RenderPass pass, const glm::mat4& view, float near, float far);
+    std::vector<SortItem> items, scratch;
+    std::unordered_map<const void*, uint32_t> shader_ids, material_ids, mesh_ids;
+};
+
+using RenderQueue = NamedHandle<RenderQueueImpl>;
+
+CPPGL_NAMESPACE_END
@@ -1,28 +1,32 @@
 #include "shader.h"
+#include "deletion_queue.h"
+#include "shader_watcher.h"
+#include "frame_uniforms.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <set>
+#include <regex>
+#include <cctype>
+#include <iomanip>
 #include <algorithm>
 #include <glm/gtc/type_ptr.hpp>
 
 CPPGL_NAMESPACE_BEGIN
 
 // paths where to search for shader files  
-std::vector<fs::path> ShaderImpl::shader_search_paths = {};  
+std::vector<fs::path> ShaderImpl::shader_search_paths = {
+#ifdef CPPGL_SHADER_DIR
+    CPPGL_SHADER_DIR, // shaders shipped with cppgl
+#endif
+};
+
+// program binary cache (disabled by default)
+fs::path ShaderImpl::program_cache_dir;
 
 // ----------------------------------------------------
 // helper funcs
 
-static std::string read_file(const fs::path& path) {
-    std::ifstream file(path);
-    if (file.is_open()) {
-        std::stringstream ss;
-        ss << file.rdbuf();
-        return ss.str();
-    }
-    return std::string();
-}
-
 static std::string get_log(GLuint object) {
     std::string error_string;
     GLint log_length = 0;
@@ -47,83 +51,253 @@ static std::string get_log(GLuint object) {
     return error_string;
 }
 
-static GLuint compile_shader(GLenum type, ShaderImpl& impl) {
+// ----------------------------------------------------
+// preprocessor
+
+// maximum #include nesting, deeper nesting is most likely an unguarded cyclic include
+static const uint32_t MAX_INCLUDE_DEPTH = 32;
+
+struct SourceFile {
+    fs::file_time_type timestamp;
+    std::vector<std::string> lines;
+    std::vector<bool> directive; // per line, preprocessor directive outside of comments
+    bool once = false; // #pragma once or classic include guard
+};
+
+// parsed files, shared by all shaders and re-read only if modified on disk (context thread only)
+static std::unordered_map<std::string, std::shared_ptr<const SourceFile>> source_cache;
+
+// scan line for block comments, returns if the end of the line is within one
+static bool ends_in_comment(const std::string& line, bool in_comment) {
+    for (size_t i = 0; i + 1 < line.size(); ++i) {
+        if (in_comment) {
+            if (line[i] == '*' && line[i + 1] == '/') { in_comment = false; ++i; }
+        } else if (line[i] == '/' && line[i + 1] == '/')
+            break;
+        else if (line[i] == '/' && line[i + 1] == '*') {
+            in_comment = true;
+            ++i;
+        }
+    }
+    return in_comment;
+}
+
+// split directive line into name and (trimmed) arguments
+static std::string parse_directive(const std::string& line, std::string& args) {
+    size_t begin = line.find('#') + 1;
+    begin = line.find_first_not_of(" \t", begin);
+    if (begin == std::string::npos) return std::string();
+    size_t end = begin;
+    while (end < line.size() && (std::isalnum(uint8_t(line[end])) || line[end] == '_')) ++end;
+    const size_t args_begin = line.find_first_not_of(" \t", end);
+    const size_t args_end = line.find_last_not_of(" \t");
+    args = args_begin == std::string::npos ? std::string() : line.substr(args_begin, args_end - args_begin + 1);
+    return line.substr(begin, end - begin);
+}
+
+// load file through the cache, returns null if it can't be read
+static std::shared_ptr<const SourceFile> load_source(const fs::path& path) {
+    std::error_code ec;
+    const fs::file_time_type timestamp = fs::last_write_time(path, ec);
+    if (ec) return 0;
+    const std::string key = fs::weakly_canonical(path, ec).string();
+    const auto it = source_cache.find(key);
+    if (it != source_cache.end() && it->second->timestamp == timestamp)
+        return it->second;
+    std::ifstream stream(path);
+    if (!stream.is_open()) return 0;
+    auto file = std::make_shared<SourceFile>();
+    file->timestamp = timestamp;
+    std::string line;
+    bool in_comment = false;
+    std::vector<size_t> directives;
+    while (std::getline(stream, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        const size_t first = line.find_first_not_of(" \t");
+        const bool directive = !in_comment && first != std::string::npos && line[first] == '#';
+        if (directive) directives.push_back(file->lines.size());
+        in_comment = ends_in_comment(line, in_comment);
+        file->lines.push_back(line);
+        file->directive.push_back(directive);
+    }
+    // detect #pragma once (removed, unknown to GLSL) and include guards (#ifndef X, #define X, ..., #endif)
+    std::string args, guard;
+    for (size_t i : directives) {
+        if (parse_directive(file->lines[i], args) == "pragma" && args == "once") {
+            file->once = true;
+            file->lines[i].clear();
+            file->directive[i] = false;
+        }
+    }
+    if (directives.size() >= 3 && parse_directive(file->lines[directives[0]], guard) == "ifndef" &&
+            parse_directive(file->lines[directives[1]], args) == "define" && args == guard &&
+            parse_directive(file->lines[directives.back()], args) == "endif")
+        file->once = true;
+    source_cache[key] = file;
+    return file;
+}
+
+// find #include file relative to the including file, then in the search paths
+static fs::path resolve_include(const fs::path& including, const std::string& args) {
+    std::string name;
+    if (args.size() >= 2 && ((args.front() == '"' && args.find('"', 1) != std::string::npos) || (args.front() == '<' && args.find('>') != std::string::npos)))
+        name = args.substr(1, args.find(args.front() == '"' ? '"' : '>', 1) - 1);
+    else
+        throw std::runtime_error("ERROR: Failed to parse #include string: #include " + args + " in " + including.string());
+    fs::path path = fs::path(including).remove_filename() / name;
+    for (size_t i = 0; !fs::exists(path) && i < ShaderImpl::shader_search_paths.size(); ++i)
+        if (fs::exists(ShaderImpl::shader_search_paths[i] / name))
+            path = ShaderImpl::shader_search_paths[i] / name;
+    return path;
+}
+
+// variant defines, injected right after #version
+static std::string define_block(const ShaderDefines& defines) {
+    std::string block;
+    for (const auto& [name, value] : defines)
+        block += "#define " + name + (value.empty() ? "" : " " + value) + "\n";
+    return block;
+}
+
+// recursively expand includes, files are numbered in order of appearance and referenced via #line (GLSL >= 330 semantics)
+static void preprocess_file(const fs::path& path, const std::shared_ptr<const SourceFile>& file, ShaderImpl& impl,
+        std::vector<fs::path>& files, std::set<std::string>& included, uint32_t depth, std::string& out) {
+    const std::string id = std::to_string(files.size());
+    files.push_back(path);
+    if (depth > 0)
+        out += "#line 1 " + id + "\n";
+    std::string args;
+    for (size_t i = 0; i < file->lines.size(); ++i) {
+        const std::string& line = file->lines[i];
+        const std::string directive = file->directive[i] ? parse_directive(line, args) : std::string();
+        if (directive == "include") {
+            const fs::path inc_path = resolve_include(path, args);
+            const auto inc = load_source(inc_path);
+            if (!inc)
+                throw std::runtime_error("ERROR: Failed to open #include file: " + inc_path.string() + " (included from " + path.string() + ")");
+            if (depth + 1 >= MAX_INCLUDE_DEPTH)
+                throw std::runtime_error("ERROR: #include nested too deep (cyclic include?): " + inc_path.string());
+            // store include file timestamp for reloads
+            impl.include_timestamps[inc_path] = inc->timestamp;
+            const std::string key = fs::weakly_canonical(inc_path).string();
+            if (inc->once && included.count(key)) {
+                out += "\n";
+                continue;
+            }
+            included.insert(key);
+            preprocess_file(inc_path, inc, impl, files, included, depth + 1, out);
+            out += "#line " + std::to_string(i + 2) + " " + id + "\n";
+        } else if (directive == "version" && depth > 0)
+            out += "\n"; // only the including shader declares the version
+        else if (directive == "version" && !impl.defines.empty())
+            out += line + "\n" + define_block(impl.defines) + "#line " + std::to_string(i + 2) + " " + id + "\n";
+        else
+            out += line + "\n";
+    }
+}
+
+// read source file and resolve #includes (stores timestamps for reloads), files holds the source string numbers used in #line
+static std::string preprocess_source(GLenum type, ShaderImpl& impl, std::vector<fs::path>& files) {
     std::cout << "Loading: " << impl.source_files[type] << "..." << std::endl;
-    std::string source = read_file(impl.source_files[type]);
-    impl.timestamps[type] = fs::last_write_time(impl.source_files[type]);
-    if (source.empty())
+    const auto file = load_source(impl.source_files[type]);
+    if (!file || file->lines.empty())
         throw std::runtime_error("ERROR: Trying to compile shader from empty source!");
+    impl.timestamps[type] = file->timestamp;
+    std::set<std::string> included;
+    std::string source;
+    files.clear();
+    preprocess_file(impl.source_files[type], file, impl, files, included, 0, source);
+    if (impl.defines.empty()) return source;
+    std::string args;
+    for (size_t i = 0; i < file->lines.size(); ++i)
+        if (file->directive[i] && parse_directive(file->lines[i], args) == "version")
+            return source; // defines were injected after #version
+    return define_block(impl.defines) + "#line 1 0\n" + source;
+}
 
-    // handle single level of #include
-    std::string::size_type inc_at;
-    impl.include_timestamps.clear();
-    while ((inc_at = source.find("#include")) != std::string::npos) {
-        auto inc_to = source.find("\n", inc_at);
-        std::string inc_str = source.substr(inc_at, inc_to - inc_at);
-        std::string inc_file;
-        if (inc_str.find("\"") != std::string::npos) {
-            // uses ""
-            auto first = inc_str.find("\"") + 1;
-            auto second = inc_str.find("\"", first);
-            inc_file = inc_str.substr(first, second - first);
-        } else if (inc_str.find("<") != std::string::npos) {
-            // uses <>
-            auto first = inc_str.find("<") + 1;
-            auto second = inc_str.find(">", first);
-            inc_file = inc_str.substr(first, second - first);
-        } else
-            throw std::runtime_error("ERROR: Failed to parse #include string: " + inc_str);
-
-        // read #include-file
-        fs::path p = impl.source_files[type];
-        p = p.remove_filename() / inc_file;
-        std::ifstream f(p.c_str(), std::ios::in);
-        if (f.is_open()) {
-            std::string inc_src, line;
-            while (getline(f, line))
-                inc_src += line + "\n";
-            // replace #include with file
-            source.replace(inc_at, inc_to - inc_at, inc_src);
-        } else
-            throw std::runtime_error("ERROR: Failed to open #include file: " + inc_str);
-
-        // store include file timestamp for reloads
-        impl.include_timestamps[p] = fs::last_write_time(p);
+// error message with the offending source lines of a failed compile (mapped back to their files via #line)
+static std::string compile_error(GLuint shader, const std::vector<fs::path>& files) {
+    const std::string log = get_log(shader);
+    std::string error_msg = "ERROR: Failed to compile shader: " + files[0].string() + ".\n" + log + "\nSource:\n";
+    // locations are reported as "<file>(<line>)" or "<file>:<line>", depending on the driver
+    static const std::regex location("(\\d+)[:(](\\d+)");
+    std::set<std::pair<size_t, size_t>> printed;
+    std::string out;
+    std::stringstream logstream(log);
+    while (std::getline(logstream, out)) {
+        std::smatch match;
+        if (!std::regex_search(out, match, location)) continue;
+        const size_t id = std::stoul(match[1]), line = std::stoul(match[2]);
+        if (id >= files.size() || line == 0 || !printed.insert({ id, line }).second) continue;
+        const auto file = load_source(files[id]);
+        if (file && line <= file->lines.size())
+            error_msg += files[id].string() + "(" + std::to_string(line) + ")\t" + file->lines[line - 1] + "\n";
+    }
+    return error_msg;
+}
+
+static std::string link_error(GLuint program, const std::map<GLenum, fs::path>& source_files) {
+    std::string error_msg = "ERROR: Failed to link shader from sources:\n";
+    for (const auto& entry : source_files)
+        error_msg += entry.second.string() + "\n";
+    return error_msg + "Log: " + get_log(program) + "\n";
+}
+
+// ------------------------------------------
+// uniform block layouts
+
+static std::map<std::string, UniformBlockLayout>& uniform_block_layouts() {
+    static std::map<std::string, UniformBlockLayout> layouts = {
+        { "FrameUniforms", UniformBlockLayout{ FRAME_UNIFORMS_BINDING, sizeof(FrameUniforms), frame_uniforms_layout() } },
+    };
+    return layouts;
+}
+
+// assign binding points of registered blocks and validate their layout via reflection, returns error message if mismatched
+static std::string check_uniform_blocks(GLuint program, const std::string& name) {
+    std::string error_msg;
+    for (const auto& [block, layout] : uniform_block_layouts()) {
+        const GLuint index = glGetUniformBlockIndex(program, block.c_str());
+        if (index == GL_INVALID_INDEX) continue;
+        glUniformBlockBinding(program, index, layout.binding);
+        GLint size = 0;
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if (size_t(size) != layout.size_bytes)
+            error_msg += "ERROR: " + name + ": uniform block " + block + " has size " + std::to_string(size) +
+                ", expected " + std::to_string(layout.size_bytes) + " (std140 layout?)\n";
+        for (const auto& [member, offset] : layout.members) {
+            const char* member_name = member.c_str();
+            GLuint member_index = GL_INVALID_INDEX;
+            glGetUniformIndices(program, 1, &member_name, &member_index);
+            GLint member_offset = -1;
+            if (member_index != GL_INVALID_INDEX)
+                glGetActiveUniformsiv(program, 1, &member_index, GL_UNIFORM_OFFSET, &member_offset);
+            if (member_offset != GLint(offset))
+                error_msg += "ERROR: " + name + ": uniform block " + block + " member " + member + " at offset " + std::to_string(member_offset) +
+                    ", expected " + std::to_string(offset) + "\n";
+        }
     }
+    return error_msg;
+}
 
-    // actually compile shader
+// submit preprocessed source to the compiler (status is not queried, see compile_shader)
+static GLuint submit_shader(GLenum type, const std::string& source) {
     GLuint shader = glCreateShader(type);
     const char *src = source.c_str();
     glShaderSource(shader, 1, &src, NULL);
     glCompileShader(shader);
+    return shader;
+}
+
+// compile preprocessed source
+static GLuint compile_shader(GLenum type, const std::string& source, const std::vector<fs::path>& files) {
+    GLuint shader = submit_shader(type, source);
 
     // print error msg if failed
     GLint shaderCompiled = GL_FALSE;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &shaderCompiled);
     if (shaderCompiled != GL_TRUE) {
-        std::string log = get_log(shader);
-        std::string error_msg = "ERROR: Failed to compile shader: " + impl.source_files[type].string() + ".\n" + log + "\nSource:\n";
-        // get relevant lines
-        std::string out;
-        std::stringstream logstream(log);
-        std::vector<int> lines;
-        while (!logstream.eof()) {
-            getline(logstream, out);
-            try {
-                int line = stoi(out.substr(2, out.find(":") - 3));
-                lines.push_back(line);
-            }
-            catch (const std::exception& e) { (void) e; }
-        }
-        // print relevant lines
-        std::stringstream stream(source);
-        int line = 1;
-        while (!stream.eof()) {
-            getline(stream, out);
-            if (std::find(lines.begin(), lines.end(), line) != lines.end())
-                error_msg += "(" + std::to_string(line) + ")\t" + out + "\n";
-            line++;
-        }
+        const std::string error_msg = compile_error(shader, files);
         glDeleteShader(shader);
         std::cerr << error_msg << std::endl;
         throw std::runtime_error(error_msg);
@@ -131,30 +305,191 @@ static GLuint compile_shader(GLenum type, ShaderImpl& impl) {
     return shader;
 }
 
+// ----------------------------------------------------
+// program binary cache
+
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    GLenum format;
+    uint32_t length;
+};
+
+static const char PROGRAM_BINARY_MAGIC[4] = { 'C', 'G', 'L', 'B' };
+static const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+static bool program_binaries_supported() {
+    static const bool supported = [](){
+        GLint num_formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+        return num_formats > 0;
+    }();
+    return supported;
+}
+
+// 64 bit FNV-1a
+static uint64_t hash_string(const std::string& str, uint64_t hash = 14695981039346656037ull) {
+    for (const char c : str) {
+        hash ^= uint64_t(uint8_t(c));
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// hash of the preprocessed sources and the driver, binaries are only valid for the exact same driver
+static std::string program_cache_key(const std::map<GLenum, std::string>& sources) {
+    uint64_t hash = hash_string(std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION));
+    for (const auto& [type, source] : sources)
+        hash = hash_string(source, hash_string(std::to_string(type), hash));
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+// returns linked program or 0 if not cached or rejected by the driver
+static GLuint load_program_binary(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return 0;
+    ProgramBinaryHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || !std::equal(header.magic, header.magic + 4, PROGRAM_BINARY_MAGIC) || header.version != PROGRAM_BINARY_VERSION)
+        return 0;
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size()))
+        return 0;
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), GLsizei(binary.size()));
+    GLint link_ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+    if (link_ok != GL_TRUE) {
+        // outdated (e.g. after a driver update), replaced by the next store
+        glDeleteProgram(program);
+        return 0;
+    }
+    if (!check_uniform_blocks(program, path.string()).empty()) {
+        // stale layout, recompile from source to report the error
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static void store_program_binary(GLuint program, const fs::path& path) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    ProgramBinaryHeader header;
+    std::copy(PROGRAM_BINARY_MAGIC, PROGRAM_BINARY_MAGIC + 4, header.magic);
+    header.version = PROGRAM_BINARY_VERSION;
+    glGetProgramBinary(program, length, 0, &header.format, binary.data());
+    header.length = uint32_t(length);
+    // write to temporary file first, so concurrent runs never see partial files
+    const fs::path tmp = fs::path(path).concat(".tmp");
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "WARN: Shader: failed to write program binary cache: " << tmp << std::endl;
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), binary.size());
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) std::cerr << "WARN: Shader: failed to write program binary cache: " << path << ": " << ec.message() << std::endl;
+}
+
+// ----------------------------------------------------
+// asynchronous compilation
+
+static bool parallel_compile_supported() {
+    static const bool supported = [](){
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // let the driver decide
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        return bool(GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile);
+    }();
+    return supported;
+}
+
+// shaders with an in-flight compile_async() (context thread only)
+static std::vector<ShaderImpl*> pending_compiles;
+
+// stages to build, compute shaders are exclusive
+static std::vector<GLenum> shader_stages(const std::map<GLenum, fs::path>& source_files) {
+    if (source_files.count(GL_COMPUTE_SHADER))
+        return { GL_COMPUTE_SHADER };
+    std::vector<GLenum> stages;
+    for (GLenum type : { GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER })
+        if (source_files.count(type)) stages.push_back(type);
+    return stages;
+}
+
+// preprocess all stages and register their files for event driven reloads (see shader_watcher.h)
+static void preprocess_stages(ShaderImpl& impl, const std::vector<GLenum>& stages, std::map<GLenum, std::string>& sources,
+        std::map<GLenum, std::vector<fs::path>>& files) {
+    impl.include_timestamps.clear();
+    std::vector<fs::path> dependencies;
+    for (GLenum type : stages) {
+        sources[type] = preprocess_source(type, impl, files[type]);
+        dependencies.insert(dependencies.end(), files[type].begin(), files[type].end());
+    }
+    shader_watcher_track(impl.name, dependencies);
+}
+
+void compile_shaders_async(const std::vector<Shader>& shaders) {
+    for (Shader shader : shaders)
+        shader->compile_async();
+}
+
+size_t shader_compilation_update() {
+    // finishing removes entries, so iterate over a copy
+    const std::vector<ShaderImpl*> pending = pending_compiles;
+    for (ShaderImpl* shader : pending)
+        shader->finish_compile_async(false);
+    return pending_compiles.size();
+}
+
+void shader_compilation_finish() {
+    const std::vector<ShaderImpl*> pending = pending_compiles;
+    for (ShaderImpl* shader : pending)
+        shader->finish_compile_async(true);
+}
+
 bool reload_modified_shaders() {
+    if (shader_watcher_active())
+        return shader_watcher_update() > 0;
     bool modified = false;
     for (auto& pair : Shader::map)
         modified |= pair.second->reload_if_modified();
     return modified;
 }
 
+// ----------------------------------------------------
+// Uniform block layouts
+
+void register_uniform_block(const std::string& name, const UniformBlockLayout& layout) {
+    uniform_block_layouts()[name] = layout;
+}
+
 // ----------------------------------------------------
 // ShaderImpl
 
-ShaderImpl::ShaderImpl(const std::string& name) : name(name), id(0) {}
+ShaderImpl::ShaderImpl(const std::string& name) : name(name), id(0), frame_uniforms_block(false) {}
 
-ShaderImpl::ShaderImpl(const std::string& name, const fs::path& compute_source) : name(name), id(0) {
+ShaderImpl::ShaderImpl(const std::string& name, const fs::path& compute_source) : name(name), id(0), frame_uniforms_block(false) {
     set_compute_source(compute_source);
     compile();
 }
 
-ShaderImpl::ShaderImpl(const std::string& name, const fs::path& vertex_source, const fs::path& fragment_source) : name(name), id(0)  {
+ShaderImpl::ShaderImpl(const std::string& name, const fs::path& vertex_source, const fs::path& fragment_source) : name(name), id(0), frame_uniforms_block(false)  {
     set_vertex_source(vertex_source);
     set_fragment_source(fragment_source);
     compile();
 }
 
-ShaderImpl::ShaderImpl(const std::string& name, const fs::path& vertex_source, const fs::path& geometry_source, const fs::path& fragment_source) : name(name), id(0)  {
+ShaderImpl::ShaderImpl(const std::string& name, const fs::path& vertex_source, const fs::path& geometry_source, const fs::path& fragment_source) : name(name), id(0), frame_uniforms_block(false)  {
     set_vertex_source(vertex_source);
     set_geometry_source(geometry_source);
     set_fragment_source(fragment_source);
@@ -162,20 +497,28 @@ ShaderImpl::ShaderImpl(const std::string& name, const fs::path& vertex_source, c
 }
 
 ShaderImpl::~ShaderImpl() {
-    clear();
+    cancel_compile_async();
+    gl_delete_deferred(GLObject::PROGRAM, id);
 }
 
 void ShaderImpl::clear() {
+    cancel_compile_async();
+    GLState::forget(GLObject::PROGRAM, id);
     if (glIsProgram(id))
         glDeleteProgram(id);
     id = 0;
     source_files.clear();
     timestamps.clear();
+    defines.clear();
+    clear_variants();
+    uniform_locations.clear();
+    for (auto& entry : uniform_handles)
+        entry.second = -1;
 }
 
-void ShaderImpl::bind() const { glUseProgram(id); }
+void ShaderImpl::bind() const { GLState::use_program(id); }
 
-void ShaderImpl::unbind() const { glUseProgram(0); }
+void ShaderImpl::unbind() const { GLState::use_program(0); }
 
 void ShaderImpl::set_source(GLenum type, const fs::path& path) {
     if (!fs::exists(path)) {
@@ -197,10 +540,82 @@ void ShaderImpl::set_source(GLenum type, const fs::path& path) {
 }
 
 
+void ShaderImpl::set_define(const std::string& name, const std::string& value) {
+    const auto it = defines.find(name);
+    if (it != defines.end() && it->second == value) return;
+    defines[name] = value;
+    clear_variants();
+}
+
+void ShaderImpl::clear_defines() {
+    if (defines.empty()) return;
+    defines.clear();
+    clear_variants();
+}
+
+void ShaderImpl::clear_variants() {
+    for (const auto& [key, variant] : variants)
+        Shader::erase(variant.shader->name);
+    variants.clear();
+}
+
+uint64_t ShaderImpl::variant_key(const ShaderDefines& defines) {
+    uint64_t hash = hash_string(std::string());
+    for (const auto& [name, value] : defines) // sorted
+        hash = hash_string(name + "=" + value + ";", hash);
+    return hash;
+}
+
+Shader ShaderImpl::variant(const ShaderDefines& variant_defines, bool async) {
+    const uint64_t key = variant_key(variant_defines);
+    const auto [begin, end] = variants.equal_range(key);
+    for (auto it = begin; it != end; ++it)
+        if (it->second.defines == variant_defines) return it->second.shader;
+    std::string variant_name = name + "[";
+    for (const auto& [define, value] : variant_defines)
+        variant_name += (variant_name.back() == '[' ? "" : ",") + define + (value.empty() ? "" : "=" + value);
+    Shader shader(variant_name + "]");
+    shader->source_files = source_files;
+    shader->defines = defines;
+    for (const auto& [define, value] : variant_defines)
+        shader->defines[define] = value;
+    variants.emplace(key, Variant{ variant_defines, shader }); // keep failed variants, so they are fixed by hot reload
+    if (async)
+        shader->compile_async();
+    else
+        shader->compile();
+    return shader;
+}
+
+Shader ShaderImpl::find_variant(uint64_t key) const {
+    const auto it = variants.find(key);
+    return it != variants.end() ? it->second.shader : Shader();
+}
+
+void ShaderImpl::precompile_variants(const std::vector<ShaderDefines>& variant_defines, bool block) {
+    std::vector<Shader> shaders;
+    for (const auto& defines : variant_defines) {
+        try {
+            shaders.push_back(variant(defines, true));
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    if (!block) return;
+    for (Shader shader : shaders)
+        shader->finish_compile_async(true);
+}
+
 void ShaderImpl::add_shader_search_path(fs::path path){  
     shader_search_paths.push_back(path);
 }
 
+void ShaderImpl::set_program_cache_dir(const fs::path& path) {
+    if (!path.empty())
+        fs::create_directories(path);
+    program_cache_dir = path;
+}
+
 void ShaderImpl::set_vertex_source(const fs::path& path) {
     set_source(GL_VERTEX_SHADER, path);
 }
@@ -226,74 +641,172 @@ void ShaderImpl::set_compute_source(const fs::path& path) {
 }
 
 void ShaderImpl::compile() {
-    // compile shaders
-    GLuint program = glCreateProgram();
-    if (source_files.count(GL_COMPUTE_SHADER)) { // is compute shader
-        GLuint shader = compile_shader(GL_COMPUTE_SHADER, *this);
-        if (!shader) {
+    cancel_compile_async(); // superseded
+    const std::vector<GLenum> stages = shader_stages(source_files);
+    std::map<GLenum, std::string> sources;
+    std::map<GLenum, std::vector<fs::path>> files;
+    preprocess_stages(*this, stages, sources, files);
+
+    // try the program binary cache first
+    GLuint program = 0;
+    fs::path cache_file;
+    if (!program_cache_dir.empty() && program_binaries_supported()) {
+        cache_file = program_cache_dir / (program_cache_key(sources) + ".bin");
+        program = load_program_binary(cache_file);
+    }
+
+    if (!program) {
+        // compile shaders
+        program = glCreateProgram();
+        std::vector<GLuint> shaders;
+        try {
+            for (GLenum type : stages)
+                shaders.push_back(compile_shader(type, sources[type], files[type]));
+        } catch (...) {
+            for (GLuint shader : shaders)
+                glDeleteShader(shader);
             glDeleteProgram(program);
-            return;
-        }
-        glAttachShader(program, shader);
-    } else { // is pipeline
-        if (source_files.count(GL_VERTEX_SHADER)) {
-            GLuint shader = compile_shader(GL_VERTEX_SHADER, *this);
-            if (!shader) {
-                glDeleteProgram(program);
-                return;
-            }
-            glAttachShader(program, shader);
+            throw;
         }
-        if (source_files.count(GL_TESS_CONTROL_SHADER)) {
-            GLuint shader = compile_shader(GL_TESS_CONTROL_SHADER, *this);
-            if (!shader) {
-                glDeleteProgram(program);
-                return;
-            }
-            glAttachShader(program, shader);
-        }
-        if (source_files.count(GL_TESS_EVALUATION_SHADER)) {
-            GLuint shader = compile_shader(GL_TESS_EVALUATION_SHADER, *this);
-            if (!shader) {
-                glDeleteProgram(program);
-                return;
-            }
+        for (GLuint shader : shaders)
             glAttachShader(program, shader);
+        // link program
+        if (!cache_file.empty())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        for (GLuint shader : shaders) {
+            glDetachShader(program, shader);
+            glDeleteShader(shader);
         }
-        if (source_files.count(GL_GEOMETRY_SHADER)) {
-            GLuint shader = compile_shader(GL_GEOMETRY_SHADER, *this);
-            if (!shader) {
-                glDeleteProgram(program);
-                return;
-            }
-            glAttachShader(program, shader);
+        GLint link_ok = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+        const std::string error_msg = link_ok == GL_TRUE ? check_uniform_blocks(program, name) : link_error(program, source_files);
+        if (!error_msg.empty()) {
+            glDeleteProgram(program);
+            std::cerr << error_msg << std::endl;
+            throw std::runtime_error("Shader compilation failed, see full output in std::cerr");
         }
-        if (source_files.count(GL_FRAGMENT_SHADER)) {
-            GLuint shader = compile_shader(GL_FRAGMENT_SHADER, *this);
-            if (!shader) {
-                glDeleteProgram(program);
-                return;
-            }
-            glAttachShader(program, shader);
+        if (!cache_file.empty())
+            store_program_binary(program, cache_file);
+    }
+    install_program(program);
+}
+
+void ShaderImpl::compile_async() {
+    cancel_compile_async(); // superseded
+    const std::vector<GLenum> stages = shader_stages(source_files);
+    std::map<GLenum, std::string> sources;
+    std::map<GLenum, std::vector<fs::path>> files;
+    preprocess_stages(*this, stages, sources, files);
+
+    // cached binaries are installed right away
+    fs::path cache_file;
+    if (!program_cache_dir.empty() && program_binaries_supported()) {
+        cache_file = program_cache_dir / (program_cache_key(sources) + ".bin");
+        const GLuint program = load_program_binary(cache_file);
+        if (program) {
+            install_program(program);
+            return;
         }
     }
-    // link program
-    glLinkProgram(program);
+
+    // submit all stages and the link without querying any status, so the driver can compile in the background
+    parallel_compile_supported();
+    pending.program = glCreateProgram();
+    for (GLenum type : stages)
+        pending.shaders.emplace_back(type, submit_shader(type, sources[type]));
+    for (const auto& [type, shader] : pending.shaders)
+        glAttachShader(pending.program, shader);
+    if (!cache_file.empty())
+        glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending.program);
+    pending.files = std::move(files);
+    pending.cache_file = cache_file;
+    pending_compiles.push_back(this);
+}
+
+bool ShaderImpl::finish_compile_async(bool block) {
+    if (!pending.program) return true;
+    if (!block && parallel_compile_supported()) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+        if (done != GL_TRUE) return false;
+    }
+    PendingCompile result = std::move(pending);
+    pending = PendingCompile();
+    pending_compiles.erase(std::remove(pending_compiles.begin(), pending_compiles.end(), this), pending_compiles.end());
+
     GLint link_ok = GL_FALSE;
-    glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+    glGetProgramiv(result.program, GL_LINK_STATUS, &link_ok);
+    std::string error_msg;
     if (link_ok != GL_TRUE) {
-        std::string error_msg = "ERROR: Failed to link shader from sources:\n";
-        for (const auto& entry : source_files)
-            error_msg += entry.second.string() + "\n";
-        error_msg += "Log: " + get_log(program) + "\n";
-        glDeleteProgram(program);
+        // report compile errors of each stage, else the link error
+        for (const auto& [type, shader] : result.shaders) {
+            GLint compiled = GL_FALSE;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if (compiled != GL_TRUE)
+                error_msg += compile_error(shader, result.files[type]);
+        }
+        if (error_msg.empty())
+            error_msg = link_error(result.program, source_files);
+    } else
+        error_msg = check_uniform_blocks(result.program, name);
+    for (const auto& [type, shader] : result.shaders) {
+        glDetachShader(result.program, shader);
+        glDeleteShader(shader);
+    }
+    if (!error_msg.empty()) {
+        // keep previous program
+        glDeleteProgram(result.program);
         std::cerr << error_msg << std::endl;
-        throw std::runtime_error("Shader compilation failed, see full output in std::cerr");
+        return true;
     }
-    // success, set new id
+    if (!result.cache_file.empty())
+        store_program_binary(result.program, result.cache_file);
+    install_program(result.program);
+    return true;
+}
+
+void ShaderImpl::cancel_compile_async() {
+    if (!pending.program) return;
+    for (const auto& [type, shader] : pending.shaders)
+        glDeleteShader(shader);
+    gl_delete_deferred(GLObject::PROGRAM, pending.program);
+    pending = PendingCompile();
+    pending_compiles.erase(std::remove(pending_compiles.begin(), pending_compiles.end(), this), pending_compiles.end());
+}
+
+void ShaderImpl::install_program(GLuint program) {
+    GLState::forget(GLObject::PROGRAM, id);
     if (glIsProgram(id))
         glDeleteProgram(id);
     id = program;
+    frame_uniforms_block = glGetUniformBlockIndex(id, "FrameUniforms") != GL_INVALID_INDEX;
+    update_uniform_locations();
+}
+
+void ShaderImpl::update_uniform_locations() {
+    uniform_locations.clear();
+    GLint num_uniforms = 0, max_length = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<char> buf(max_length + 1);
+    for (GLint i = 0; i < num_uniforms; ++i) {
+        GLint size = 0;
+        GLenum type;
+        GLsizei length = 0;
+        glGetActiveUniform(id, i, GLsizei(buf.size()), &length, &size, &type, buf.data());
+        const std::string name(buf.data(), length);
+        const GLint loc = glGetUniformLocation(id, name.c_str());
+        if (loc < 0) continue; // member of a uniform block
+        uniform_locations[name] = loc;
+        // arrays are reported as "name[0]", make them accessible via "name" as well
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            uniform_locations[name.substr(0, name.size() - 3)] = loc;
+    }
+    // re-resolve handles, locations may have changed
+    for (auto& entry : uniform_handles)
+        entry.second = uniform_location(entry.first);
 }
 
 void ShaderImpl::dispatch_compute(uint32_t w, uint32_t h, uint32_t d, GLbitfield memory_barrier_bits) const {
@@ -304,99 +817,214 @@ void ShaderImpl::dispatch_compute(uint32_t w, uint32_t h, uint32_t d, GLbitfield
         glMemoryBarrier(memory_barrier_bits);
 }
 
+GLint ShaderImpl::uniform_location(const std::string& name) const {
+    const auto it = uniform_locations.find(name);
+    if (it != uniform_locations.end()) return it->second;
+    // not reported by introspection (e.g. inactive or non-zero array element), ask once and remember the result
+    const GLint loc = glGetUniformLocation(id, name.c_str());
+    uniform_locations.emplace(name, loc);
+    return loc;
+}
+
+UniformHandle ShaderImpl::uniform_handle(const std::string& name) const {
+    const auto it = uniform_handle_indices.find(name);
+    if (it != uniform_handle_indices.end()) return UniformHandle{ it->second };
+    const uint32_t index = uint32_t(uniform_handles.size());
+    uniform_handles.emplace_back(name, uniform_location(name));
+    uniform_handle_indices.emplace(name, index);
+    return UniformHandle{ index };
+}
+
 void ShaderImpl::uniform(const std::string& name, int val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform1i(loc, val);
 }
 
 void ShaderImpl::uniform(const std::string& name, uint32_t val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform1i(loc, val);
 }
 
 void ShaderImpl::uniform(const std::string& name, int *val, uint32_t count) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform1iv(loc, count, val);
 }
 
 void ShaderImpl::uniform(const std::string& name, uint32_t* val, uint32_t count) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform1uiv(loc, count, val);
 }
 
 void ShaderImpl::uniform(const std::string& name, float val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform1f(loc, val);
 }
 
 void ShaderImpl::uniform(const std::string& name, float *val, uint32_t count) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform1fv(loc, count, val);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::vec2& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform2f(loc, val.x, val.y);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::vec3& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform3f(loc, val.x, val.y, val.z);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::vec4& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform4f(loc, val.x, val.y, val.z, val.w);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::ivec2& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform2i(loc, val.x, val.y);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::ivec3& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform3i(loc, val.x, val.y, val.z);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::ivec4& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform4i(loc, val.x, val.y, val.z, val.w);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::uvec2& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform2ui(loc, val.x, val.y);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::uvec3& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform3ui(loc, val.x, val.y, val.z);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::uvec4& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniform4ui(loc, val.x, val.y, val.z, val.w);
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::mat3& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniformMatrix3fv(loc, 1, GL_FALSE, glm::value_ptr(val));
 }
 
 void ShaderImpl::uniform(const std::string& name, const glm::mat4& val) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(val));
 }
 
 void ShaderImpl::uniform(const std::string& name, const Texture2D& tex, uint32_t unit) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
     tex->bind(unit);
     glUniform1i(loc, unit);
 }
 
 void ShaderImpl::uniform(const std::string& name, const Texture3D& tex, uint32_t unit) const {
-    int loc = glGetUniformLocation(id, name.c_str());
+    const GLint loc = uniform_location(name);
+    tex->bind(unit);
+    glUniform1i(loc, unit);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, int val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform1i(loc, val);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, uint32_t val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform1i(loc, val);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, int *val, uint32_t count) const {
+    const GLint loc = uniform_location(handle);
+    glUniform1iv(loc, count, val);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, uint32_t* val, uint32_t count) const {
+    const GLint loc = uniform_location(handle);
+    glUniform1uiv(loc, count, val);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, float val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform1f(loc, val);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, float *val, uint32_t count) const {
+    const GLint loc = uniform_location(handle);
+    glUniform1fv(loc, count, val);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::vec2& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform2f(loc, val.x, val.y);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::vec3& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform3f(loc, val.x, val.y, val.z);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::vec4& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform4f(loc, val.x, val.y, val.z, val.w);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::ivec2& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform2i(loc, val.x, val.y);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::ivec3& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform3i(loc, val.x, val.y, val.z);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::ivec4& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform4i(loc, val.x, val.y, val.z, val.w);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::uvec2& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform2ui(loc, val.x, val.y);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::uvec3& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform3ui(loc, val.x, val.y, val.z);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::uvec4& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniform4ui(loc, val.x, val.y, val.z, val.w);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::mat3& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniformMatrix3fv(loc, 1, GL_FALSE, glm::value_ptr(val));
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const glm::mat4& val) const {
+    const GLint loc = uniform_location(handle);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(val));
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const Texture2D& tex, uint32_t unit) const {
+    const GLint loc = uniform_location(handle);
+    tex->bind(unit);
+    glUniform1i(loc, unit);
+}
+
+void ShaderImpl::uniform(const UniformHandle& handle, const Texture3D& tex, uint32_t unit) const {
+    const GLint loc = uniform_location(handle);
     tex->bind(unit);
     glUniform1i(loc, unit);
 }
@@ -406,7 +1034,7 @@ bool ShaderImpl::reload_if_modified() {
     for (const auto& entry : source_files) {
         try {
             if (fs::last_write_time(entry.second) != timestamps[entry.first]) {
-                compile();
+                compile_async();
                 return true;
             }
         } catch (std::exception& e) {
@@ -418,7 +1046,7 @@ bool ShaderImpl::reload_if_modified() {
     for (const auto& entry : include_timestamps) {
         try {
             if (fs::last_write_time(entry.first) != entry.second) {
-                compile();
+                compile_async();
                 return true;
             }
         } catch (std::exception& e) {
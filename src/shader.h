@@ -6,6 +6,7 @@ namespace fs = std::filesystem;
 #include <map>
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <glm/glm.hpp>
@@ -14,6 +15,30 @@ namespace fs = std::filesystem;
 
 CPPGL_NAMESPACE_BEGIN
 
+// ------------------------------------------
+// Pre-resolved uniform (see ShaderImpl::uniform_handle)
+
+struct UniformHandle {
+    uint32_t index = uint32_t(-1); // slot in the shader's handle table
+};
+
+// ------------------------------------------
+// Uniform block layout shared between C++ and GLSL (std140), validated via reflection after each link
+
+struct UniformBlockLayout {
+    uint32_t binding; // fixed binding point, assigned to the block on link
+    size_t size_bytes; // sizeof the C++ struct
+    std::vector<std::pair<std::string, size_t>> members; // member name -> offset in bytes
+};
+
+// register layout for all blocks with the given name (FrameUniforms is registered by default, see frame_uniforms.h)
+void register_uniform_block(const std::string& name, const UniformBlockLayout& layout);
+
+// ------------------------------------------
+// Shader permutation defines (name -> value, empty value for a plain #define NAME)
+
+using ShaderDefines = std::map<std::string, std::string>;
+
 // ------------------------------------------
 // Shader
 
@@ -49,6 +74,19 @@ public:
 
     // compile and link shader from previously given source files
     void compile();
+    // submit compile and link without waiting for the driver (KHR_parallel_shader_compile), the previous program
+    // stays in use until the new one is installed by finish_compile_async(), usually via shader_compilation_update()
+    // Note: errors are reported to std::cerr and keep the previous program (if any)
+    void compile_async();
+    // install the program of a finished compile_async(), returns false if still compiling (and not blocking)
+    bool finish_compile_async(bool block = true);
+    // discard an in-flight compile_async()
+    void cancel_compile_async();
+    inline bool compiling() const { return pending.program != 0; }
+    // true if a program is available (false e.g. while the first compile_async() is in flight)
+    inline bool ready() const { return id != 0; }
+    // rebuild uniform location table from program introspection (called by compile)
+    void update_uniform_locations();
 
     // compute shader dispatch (call with actual amount of threads, will internally divide by workgroup size), memory_barrier_bits is option for automatic glMemoryBarrier(memory_barrier_bits)
     void dispatch_compute(uint32_t w, uint32_t h = 1, uint32_t d = 1, GLbitfield memory_barrier_bits = GL_ALL_BARRIER_BITS) const;
@@ -74,13 +112,58 @@ public:
     void uniform(const std::string& name, const Texture2D& tex, uint32_t unit) const;
     void uniform(const std::string& name, const Texture3D& tex, uint32_t unit) const;
 
+    // uniform location lookup (cached, rebuilt via reflection after each compile, -1 if not present)
+    GLint uniform_location(const std::string& name) const;
+    // pre-resolve uniform for use in hot loops (no string operations, stays valid across recompiles)
+    UniformHandle uniform_handle(const std::string& name) const;
+    inline GLint uniform_location(const UniformHandle& handle) const { return handle.index < uniform_handles.size() ? uniform_handles[handle.index].second : -1; }
+
+    // uniform upload handling via pre-resolved handles
+    void uniform(const UniformHandle& handle, int val) const;
+    void uniform(const UniformHandle& handle, uint32_t val) const;
+    void uniform(const UniformHandle& handle, int* val, uint32_t count) const;
+    void uniform(const UniformHandle& handle, uint32_t* val, uint32_t count) const;
+    void uniform(const UniformHandle& handle, float val) const;
+    void uniform(const UniformHandle& handle, float* val, uint32_t count) const;
+    void uniform(const UniformHandle& handle, const glm::vec2& val) const;
+    void uniform(const UniformHandle& handle, const glm::vec3& val) const;
+    void uniform(const UniformHandle& handle, const glm::vec4& val) const;
+    void uniform(const UniformHandle& handle, const glm::ivec2& val) const;
+    void uniform(const UniformHandle& handle, const glm::ivec3& val) const;
+    void uniform(const UniformHandle& handle, const glm::ivec4& val) const;
+    void uniform(const UniformHandle& handle, const glm::uvec2& val) const;
+    void uniform(const UniformHandle& handle, const glm::uvec3& val) const;
+    void uniform(const UniformHandle& handle, const glm::uvec4& val) const;
+    void uniform(const UniformHandle& handle, const glm::mat3& val) const;
+    void uniform(const UniformHandle& handle, const glm::mat4& val) const;
+    void uniform(const UniformHandle& handle, const Texture2D& tex, uint32_t unit) const;
+    void uniform(const UniformHandle& handle, const Texture3D& tex, uint32_t unit) const;
+
     // clear shader
     void clear();
-    // check and reload if modified (return true if reloaded)
+    // check and reload if modified (asynchronously, return true if a reload was started)
     bool reload_if_modified();
+
+    // set define to be injected after #version on the next compile (changes drop all variants, see below)
+    void set_define(const std::string& name, const std::string& value = "");
+    void clear_defines();
+    // permutations: variants are separate shaders (named e.g. "draw[ALPHA_TEST,LIGHTS=4]") from the same source files,
+    // compiled with the defines of this shader plus the given ones, and registered in Shader::map (thus hot reloaded)
+    // variants are dropped once the defines of this shader change, as they bake in a copy of them
+    // key to look up a variant by (order independent hash of the given defines)
+    static uint64_t variant_key(const ShaderDefines& defines);
+    // find or lazily create and compile a variant (asynchronously if requested, see compile_async)
+    NamedHandle<ShaderImpl> variant(const ShaderDefines& defines, bool async = false);
+    // lookup of an existing variant without string operations (null handle if not yet created, trusts the hash)
+    NamedHandle<ShaderImpl> find_variant(uint64_t key) const;
+    // create and compile all given variants in bulk (submitted at once, see compile_shaders_async)
+    void precompile_variants(const std::vector<ShaderDefines>& variants, bool block = true);
     
     // set default paths to search for shader source files
     static void add_shader_search_path(fs::path path);
+    // enable on-disk program binary cache in given directory (empty path disables it)
+    // binaries are keyed by the preprocessed sources and the driver, invalid entries fall back to compiling from source
+    static void set_program_cache_dir(const fs::path& path);
 
     // data
     const std::string name;
@@ -88,12 +171,42 @@ public:
     std::map<GLenum, fs::path> source_files;
     std::map<GLenum, fs::file_time_type> timestamps;
     std::map<fs::path, fs::file_time_type> include_timestamps;
+    ShaderDefines defines;
+    bool frame_uniforms_block; // declares FrameUniforms, so camera matrices don't need to be set per draw
+    struct Variant {
+        ShaderDefines defines; // as given to variant(), compared on lookup in case of hash collisions
+        NamedHandle<ShaderImpl> shader;
+    };
+    std::unordered_multimap<uint64_t, Variant> variants;
+    mutable std::unordered_map<std::string, GLint> uniform_locations;
+    mutable std::unordered_map<std::string, uint32_t> uniform_handle_indices;
+    mutable std::vector<std::pair<std::string, GLint>> uniform_handles;
     
     static std::vector<fs::path> shader_search_paths;
+    static fs::path program_cache_dir;
+
+private:
+    void install_program(GLuint program);
+    void clear_variants();
+
+    struct PendingCompile {
+        GLuint program = 0;
+        std::vector<std::pair<GLenum, GLuint>> shaders;
+        std::map<GLenum, std::vector<fs::path>> files; // source string numbers of each stage, for error messages
+        fs::path cache_file;
+    };
+    PendingCompile pending;
 };
 
 using Shader = NamedHandle<ShaderImpl>;
 
 bool reload_modified_shaders();
 
+// batch compilation: submit all shaders first (see ShaderImpl::compile_async), collect results later
+void compile_shaders_async(const std::vector<Shader>& shaders);
+// install finished programs (called once per frame by Context::swap_buffers), returns amount still compiling
+size_t shader_compilation_update();
+// block until all asynchronous compiles are finished
+void shader_compilation_finish();
+
 CPPGL_NAMESPACE_END
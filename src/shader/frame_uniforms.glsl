@@ -0,0 +1,21 @@
+// per-frame uniforms, written once per frame by cppgl (see frame_uniforms.h, keep both in sync!)
+// the binding point is assigned on link, so no layout (binding = ...) is required
+#pragma once
+
+layout (std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 view_normal;
+    mat4 proj;
+    mat4 view_proj;
+    mat4 inv_view;
+    mat4 inv_proj;
+    vec4 camera_pos; // w: 1
+    vec4 camera_dir; // w: 0
+    vec2 resolution;
+    float time; // s
+    float delta_time; // s
+    uint frame;
+    float camera_near;
+    float camera_far;
+    float camera_fov; // degree
+};
@@ -0,0 +1,10 @@
+// decoding helpers for compressed vertex formats (see vertex_format.h)
+
+// octahedral normal encoding, input is a snorm16x2 attribute in [-1, 1]
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
@@ -0,0 +1,185 @@
+#include "shader_watcher.h"
+#include "shader.h"
+#include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <iostream>
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// state
+
+struct ShaderWatcher {
+    std::mutex mutex;
+    std::map<fs::path, std::set<std::string>> dependents; // file -> shaders
+    std::map<std::string, std::vector<fs::path>> dependencies; // shader -> files
+    std::map<fs::path, int> watches; // directory -> watch descriptor
+    std::map<int, fs::path> watched_dirs; // watch descriptor -> directory
+    std::set<fs::path> changed; // written by watcher thread
+    std::atomic<bool> dirty{false};
+    std::atomic<bool> running{false};
+    int inotify_fd = -1, wakeup_fd = -1;
+    std::thread thread;
+};
+
+// intentionally leaked, shaders may still be tracked during static destruction
+static ShaderWatcher& watcher = *new ShaderWatcher;
+
+// ------------------------------------------
+// helper funcs
+
+static fs::path canonical_path(const fs::path& path) {
+    std::error_code ec;
+    const fs::path canonical = fs::weakly_canonical(path, ec);
+    return ec ? path.lexically_normal() : canonical;
+}
+
+#ifdef __linux__
+
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+// requires lock on watcher.mutex
+static void add_watch(const fs::path& dir) {
+    if (watcher.watches.count(dir)) return;
+    const int wd = inotify_add_watch(watcher.inotify_fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        std::cerr << "WARN: ShaderWatcher: unable to watch directory: " << dir << std::endl;
+        return;
+    }
+    watcher.watches[dir] = wd;
+    watcher.watched_dirs[wd] = dir;
+}
+
+static void watch_loop() {
+    alignas(struct inotify_event) char buf[4096];
+    pollfd fds[2] = { { watcher.inotify_fd, POLLIN, 0 }, { watcher.wakeup_fd, POLLIN, 0 } };
+    while (watcher.running) {
+        if (poll(fds, 2, -1) < 0) continue; // EINTR
+        if (fds[1].revents & POLLIN) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+        const ssize_t len = read(watcher.inotify_fd, buf, sizeof(buf));
+        if (len <= 0) continue;
+        std::lock_guard<std::mutex> lock(watcher.mutex);
+        for (ssize_t i = 0; i < len; i += sizeof(struct inotify_event) + ((const struct inotify_event*)(buf + i))->len) {
+            const struct inotify_event* event = (const struct inotify_event*)(buf + i);
+            auto it = watcher.watched_dirs.find(event->wd);
+            if (it == watcher.watched_dirs.end() || event->len == 0) continue;
+            const fs::path path = it->second / event->name;
+            if (!watcher.dependents.count(path)) continue; // not a shader source, e.g. an editor's swap file
+            watcher.changed.insert(path);
+            watcher.dirty = true;
+        }
+    }
+}
+
+#endif
+
+// ------------------------------------------
+// Shader watcher
+
+void shader_watcher_start() {
+    if (watcher.running) return;
+#ifdef __linux__
+    watcher.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watcher.wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher.inotify_fd < 0 || watcher.wakeup_fd < 0) {
+        if (watcher.inotify_fd >= 0) close(watcher.inotify_fd);
+        if (watcher.wakeup_fd >= 0) close(watcher.wakeup_fd);
+        watcher.inotify_fd = watcher.wakeup_fd = -1;
+        std::cerr << "WARN: ShaderWatcher: failed to initialize inotify, falling back to polling." << std::endl;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(watcher.mutex);
+        for (const auto& entry : watcher.dependents)
+            add_watch(entry.first.parent_path());
+    }
+    watcher.running = true;
+    watcher.thread = std::thread(watch_loop);
+#else
+    std::cerr << "WARN: ShaderWatcher: not supported on this platform, falling back to polling." << std::endl;
+#endif
+}
+
+void shader_watcher_stop() {
+    if (!watcher.running) return;
+#ifdef __linux__
+    watcher.running = false;
+    const uint64_t one = 1;
+    if (write(watcher.wakeup_fd, &one, sizeof(one)) < 0)
+        std::cerr << "WARN: ShaderWatcher: failed to wake up watcher thread." << std::endl;
+    watcher.thread.join();
+    close(watcher.inotify_fd);
+    close(watcher.wakeup_fd);
+    watcher.inotify_fd = watcher.wakeup_fd = -1;
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+    watcher.watches.clear();
+    watcher.watched_dirs.clear();
+    watcher.changed.clear();
+    watcher.dirty = false;
+#endif
+}
+
+bool shader_watcher_active() {
+    return watcher.running;
+}
+
+size_t shader_watcher_update() {
+    if (!watcher.dirty) return 0;
+    std::set<std::string> shaders;
+    {
+        std::lock_guard<std::mutex> lock(watcher.mutex);
+        for (const auto& path : watcher.changed) {
+            auto it = watcher.dependents.find(path);
+            if (it != watcher.dependents.end())
+                shaders.insert(it->second.begin(), it->second.end());
+        }
+        watcher.changed.clear();
+        watcher.dirty = false;
+    }
+    size_t queued = 0;
+    for (const auto& name : shaders) {
+        if (!Shader::valid(name)) continue;
+        try {
+            Shader::find(name)->compile_async();
+            queued++;
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    return queued;
+}
+
+void shader_watcher_track(const std::string& shader_name, const std::vector<fs::path>& files) {
+    std::vector<fs::path> canonical;
+    for (const auto& file : files)
+        canonical.push_back(canonical_path(file));
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+    // drop previous edges, the include structure may have changed
+    auto& deps = watcher.dependencies[shader_name];
+    for (const auto& file : deps) {
+        auto it = watcher.dependents.find(file);
+        if (it == watcher.dependents.end()) continue;
+        it->second.erase(shader_name);
+        if (it->second.empty()) watcher.dependents.erase(it);
+    }
+    deps = canonical;
+    for (const auto& file : deps) {
+        watcher.dependents[file].insert(shader_name);
+#ifdef __linux__
+        if (watcher.running)
+            add_watch(file.parent_path());
+#endif
+    }
+}
+
+CPPGL_NAMESPACE_END
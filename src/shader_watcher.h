@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+namespace fs = std::filesystem;
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Event driven shader hot reload
+// Each (re-)compile registers all source and include files of a shader in a reverse dependency graph (file -> shaders).
+// While the watcher is active, a background thread waits on inotify events for the directories of those files and
+// marks changed files, shader_watcher_update() then asynchronously recompiles only the shaders depending on them.
+// Frames without file changes cost a single atomic load, instead of stat'ing every file of every shader.
+// Note: inotify is only available on linux, on other platforms shader_watcher_start() warns and
+// reload_modified_shaders() keeps polling timestamps.
+
+// start watching all registered files (no-op if already running)
+void shader_watcher_start();
+// stop the watcher thread, reload_modified_shaders() falls back to polling
+void shader_watcher_stop();
+bool shader_watcher_active();
+
+// queue shaders depending on changed files for recompilation, returns the amount of shaders queued
+// (called once per frame by Context::swap_buffers)
+size_t shader_watcher_update();
+
+// (re-)register the files a shader depends on (called by ShaderImpl on each compile)
+void shader_watcher_track(const std::string& shader_name, const std::vector<fs::path>& files);
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,105 @@
+#include "stream_buffer.h"
+#include <algorithm>
+#include <stdexcept>
+#include "deletion_queue.h"
+#include "gl_state.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// helper funcs
+
+static void unmap_buffer(GLuint id) {
+    if (GLState::dsa)
+        glUnmapNamedBuffer(id);
+    else {
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, id);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+// ------------------------------------------
+// StreamBuffer
+
+StreamBufferImpl::StreamBufferImpl(const std::string& name, size_t frame_size_bytes, uint32_t frames_in_flight)
+    : name(name), id(0), ptr(0), frame_size(0), frames_in_flight(std::max(1u, frames_in_flight)), frame(0), head(0),
+    fences(std::max(1u, frames_in_flight), GLsync(0)) {
+    if (!GLEW_ARB_buffer_storage)
+        throw std::runtime_error("ERROR: StreamBuffer: ARB_buffer_storage not supported!");
+    GLint ubo_alignment = 0, ssbo_alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_alignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+    min_alignment = size_t(std::max(16, std::max(ubo_alignment, ssbo_alignment)));
+    create_storage(std::max(frame_size_bytes, min_alignment));
+}
+
+StreamBufferImpl::~StreamBufferImpl() {
+    // may be dropped from any thread, so leave all GL calls to the deletion queue
+    gl_defer([id = id, fences = fences]() {
+        for (GLsync fence : fences)
+            if (fence) glDeleteSync(fence);
+        if (id) {
+            unmap_buffer(id);
+            gl_delete_deferred(GLObject::BUFFER, id);
+        }
+    });
+}
+
+StreamAllocation StreamBufferImpl::allocate(size_t size_bytes, size_t alignment) {
+    alignment = alignment ? alignment : min_alignment;
+    size_t offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + size_bytes > frame_size) {
+        create_storage(std::max(2 * frame_size, size_bytes + alignment));
+        offset = 0;
+    }
+    head = offset + size_bytes;
+    offset += size_t(frame) * frame_size;
+    return StreamAllocation{ ptr + offset, id, offset, size_bytes };
+}
+
+void StreamBufferImpl::next_frame() {
+    if (fences[frame]) glDeleteSync(fences[frame]);
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % frames_in_flight;
+    head = 0;
+    // wait until the GPU is done with the segment we are about to overwrite
+    if (fences[frame]) {
+        GLenum status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+        glDeleteSync(fences[frame]);
+        fences[frame] = 0;
+    }
+}
+
+void StreamBufferImpl::create_storage(size_t new_frame_size) {
+    if (id) {
+        // release old storage once all segments in flight are done, keep it mapped until then
+        // (pointers of allocations made earlier in this frame are still written to)
+        gl_defer([old_id = id]() {
+            unmap_buffer(old_id);
+            gl_delete_deferred(GLObject::BUFFER, old_id);
+        });
+        for (GLsync& fence : fences)
+            if (fence) glDeleteSync(fence);
+        std::fill(fences.begin(), fences.end(), GLsync(0));
+    }
+    frame_size = (new_frame_size + min_alignment - 1) / min_alignment * min_alignment;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    if (GLState::dsa) {
+        glCreateBuffers(1, &id);
+        glNamedBufferStorage(id, frame_size * frames_in_flight, 0, flags);
+        ptr = (uint8_t*)glMapNamedBufferRange(id, 0, frame_size * frames_in_flight, flags);
+    } else {
+        glGenBuffers(1, &id);
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, id);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, frame_size * frames_in_flight, 0, flags);
+        ptr = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frame_size * frames_in_flight, flags);
+        GLState::bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    if (!ptr)
+        throw std::runtime_error("ERROR: StreamBuffer: failed to map buffer storage!");
+}
+
+CPPGL_NAMESPACE_END
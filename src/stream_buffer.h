@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "named_handle.h"
+#include "gl_state.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Sub-allocation of a StreamBuffer (valid for the current frame only)
+
+struct StreamAllocation {
+    void* data = 0; // persistently mapped, write only
+    GLuint buffer = 0;
+    size_t offset = 0; // in bytes
+    size_t size = 0; // in bytes
+
+    // bind as UBO/SSBO/... range to indexed binding point
+    inline void bind_range(GLenum target, uint32_t unit) const { GLState::bind_buffer_range(target, unit, buffer, offset, size); }
+    // bind as VBO/DIBO/... (offset has to be applied by the caller, e.g. in attribute pointers or indirect offsets)
+    inline void bind(GLenum target) const { GLState::bind_buffer(target, buffer); }
+};
+
+// ------------------------------------------
+// StreamBuffer (ring allocator for per-frame dynamic data)
+// One persistently and coherently mapped buffer split into a segment per frame in flight.
+// Allocations are linear within the current segment (near-memcpy cost, no implicit syncs),
+// next_frame() fences the segment and waits for the oldest one before reusing it.
+// If a frame needs more than one segment, storage is reallocated at twice the size (the old buffer stays mapped
+// and is released through the deletion queue, so allocations made earlier in the frame stay valid).
+// Note: next_frame() is called for all StreamBuffers by Context::swap_buffers.
+
+class StreamBufferImpl {
+public:
+    StreamBufferImpl(const std::string& name, size_t frame_size_bytes = 4 * 1024 * 1024, uint32_t frames_in_flight = 3);
+    virtual ~StreamBufferImpl();
+
+    // prevent copies and moves, since GL buffers aren't reference counted
+    StreamBufferImpl(const StreamBufferImpl&) = delete;
+    StreamBufferImpl& operator=(const StreamBufferImpl&) = delete;
+    StreamBufferImpl& operator=(const StreamBufferImpl&&) = delete;
+
+    // sub-allocate given amount of bytes (alignment 0: UBO/SSBO offset alignment)
+    StreamAllocation allocate(size_t size_bytes, size_t alignment = 0);
+
+    // allocate and copy data
+    template <typename T> StreamAllocation upload(const T* data, size_t count, size_t alignment = 0) {
+        const StreamAllocation alloc = allocate(count * sizeof(T), alignment);
+        if (count > 0) std::memcpy(alloc.data, data, count * sizeof(T));
+        return alloc;
+    }
+    template <typename T> StreamAllocation upload(const std::vector<T>& data, size_t alignment = 0) {
+        return upload(data.data(), data.size(), alignment);
+    }
+
+    // fence current segment and advance to the next one (blocks if the GPU is still using it)
+    void next_frame();
+
+    // data
+    const std::string name;
+    GLuint id;
+    uint8_t* ptr;
+    size_t frame_size; // in bytes, per segment
+    const uint32_t frames_in_flight;
+    uint32_t frame; // current segment
+    size_t head; // in bytes, relative to the current segment
+    size_t min_alignment; // UBO/SSBO offset alignment
+    std::vector<GLsync> fences; // per segment
+
+private:
+    void create_storage(size_t new_frame_size);
+};
+
+using StreamBuffer = NamedHandle<StreamBufferImpl>;
+
+CPPGL_NAMESPACE_END
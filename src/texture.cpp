@@ -1,4 +1,6 @@
 #include "texture.h"
+#include "deletion_queue.h"
+#include "readback.h"
 #include <vector>
 #include <iostream>
 #include "image_load_store.h"
@@ -8,9 +10,10 @@ CPPGL_NAMESPACE_BEGIN
 // ----------------------------------------------------
 // Texture2D
 
-Texture2DImpl::Texture2DImpl(const std::string& name, const fs::path& path, bool mipmap) : name(name), loaded_from_path(path), id(0) {
-    // load image from disk
-    auto [data, w_out, h_out, channels, is_hdr] = image_load(path);
+Texture2DImpl::Texture2DImpl(const std::string& name, const fs::path& path, bool mipmap) : Texture2DImpl(name, path, image_load(path), mipmap) {}
+
+Texture2DImpl::Texture2DImpl(const std::string& name, const fs::path& path, const ImageData& image, bool mipmap) : name(name), loaded_from_path(path), id(0) {
+    const auto& [data, w_out, h_out, channels, is_hdr] = image;
     this->w = w_out;
     this->h = h_out;
 
@@ -23,14 +26,6 @@ Texture2DImpl::Texture2DImpl(const std::string& name, const fs::path& path, bool
     }
     format = channels_to_format(channels);
 
-    // init GL texture
-    glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
-
     //opengl by default needs 4 byte alignment after every row
     //stbi loaded data is not aligned that way -> pixelStore attributes need to be set
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -38,16 +33,32 @@ Texture2DImpl::Texture2DImpl(const std::string& name, const fs::path& path, bool
     glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
     glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
 
+    if (GLState::dsa) {
+        allocate_immutable(&data[0], mipmap);
+        return;
+    }
+
+    // init GL texture
+    glGenTextures(1, &id);
+    GLState::bind_texture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, type, &data[0]);
     if (mipmap) glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
 }
 
 Texture2DImpl::Texture2DImpl(const std::string& name, uint32_t w, uint32_t h, GLint internal_format, GLenum format, GLenum type, const void* data, bool mipmap)
     : name(name), id(0), w(w), h(h), internal_format(internal_format), format(format), type(type) {
+    if (GLState::dsa) {
+        allocate_immutable(data, mipmap);
+        return;
+    }
     // init GL texture
     glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
+    GLState::bind_texture(GL_TEXTURE_2D, id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (format == GL_DEPTH_COMPONENT || format == GL_DEPTH_STENCIL) ? GL_NEAREST : GL_LINEAR);
@@ -55,29 +66,49 @@ Texture2DImpl::Texture2DImpl(const std::string& name, uint32_t w, uint32_t h, GL
             mipmap ? GL_LINEAR_MIPMAP_LINEAR : (format == GL_DEPTH_COMPONENT || format == GL_DEPTH_STENCIL) ? GL_NEAREST : GL_LINEAR);
     glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, type, data);
     if (mipmap) glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
 }
 
 Texture2DImpl::~Texture2DImpl() {
-    if (glIsTexture(id))
-        glDeleteTextures(1, &id);
+    gl_delete_deferred(GLObject::TEXTURE, id);
 }
 
 void Texture2DImpl::resize(uint32_t w, uint32_t h) {
     this->w = w;
     this->h = h;
-    glBindTexture(GL_TEXTURE_2D, id);
+    if (GLState::dsa) {
+        // immutable storage can't be respecified, so replace the texture object (keeping the mipmap setting)
+        GLint min_filter = GL_LINEAR;
+        glGetTextureParameteriv(id, GL_TEXTURE_MIN_FILTER, &min_filter);
+        return allocate_immutable(0, min_filter != GL_LINEAR && min_filter != GL_NEAREST);
+    }
+    GLState::bind_texture(GL_TEXTURE_2D, id);
     glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, type, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
+}
+
+void Texture2DImpl::allocate_immutable(const void* data, bool mipmap) {
+    if (id) gl_delete_deferred(GLObject::TEXTURE, id);
+    const bool depth = format == GL_DEPTH_COMPONENT || format == GL_DEPTH_STENCIL;
+    glCreateTextures(GL_TEXTURE_2D, 1, &id);
+    glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+    glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, mipmap ? GL_LINEAR_MIPMAP_LINEAR : depth ? GL_NEAREST : GL_LINEAR);
+    if (w <= 0 || h <= 0) return; // empty storage is invalid
+    glTextureStorage2D(id, mipmap ? mip_levels(w, h) : 1, sized_internal_format(internal_format, type), w, h);
+    if (data) {
+        glTextureSubImage2D(id, 0, 0, 0, w, h, format, type, data);
+        if (mipmap) glGenerateTextureMipmap(id);
+    }
 }
 
 void Texture2DImpl::bind(uint32_t unit) const {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, id);
+    GLState::bind_texture(unit, GL_TEXTURE_2D, id);
 }
 
 void Texture2DImpl::unbind() const {
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
 }
 
 void Texture2DImpl::bind_image(uint32_t unit, GLenum access, GLenum format, uint32_t level) const {
@@ -89,11 +120,19 @@ void Texture2DImpl::unbind_image(uint32_t unit) const {
 }
 
 void Texture2DImpl::save_ldr(const fs::path& path, bool flip, bool async) const {
-    std::vector<uint8_t> pixels(size_t(w) * h * format_to_channels(format));
-    glBindTexture(GL_TEXTURE_2D, id);
+    const int w = this->w, h = this->h, channels = format_to_channels(format);
+    if (async) {
+        // read back without stalling, write to disk once the data arrived
+        readback_texture_async(*this, format, GL_UNSIGNED_BYTE, 0, [path, w, h, channels, flip](const std::vector<uint8_t>& pixels) {
+            image_store_ldr(path, pixels.data(), w, h, channels, flip, true);
+        });
+        return;
+    }
+    std::vector<uint8_t> pixels(size_t(w) * h * channels);
+    GLState::bind_texture(GL_TEXTURE_2D, id);
     glGetTexImage(GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, &pixels[0]);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    image_store_ldr(path, pixels.data(), w, h, format_to_channels(format), flip, async);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
+    image_store_ldr(path, pixels.data(), w, h, channels, flip, false);
 }
 
 // ----------------------------------------------------
@@ -101,9 +140,13 @@ void Texture2DImpl::save_ldr(const fs::path& path, bool flip, bool async) const
 
 Texture3DImpl::Texture3DImpl(const std::string& name, uint32_t w, uint32_t h, uint32_t d, GLint internal_format, GLenum format, GLenum type, const void* data, bool mipmap)
     : name(name), id(0), w(w), h(h), d(d), internal_format(internal_format), format(format), type(type) {
+    if (GLState::dsa) {
+        allocate_immutable(data, mipmap);
+        return;
+    }
     // init GL texture
     glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_3D, id);
+    GLState::bind_texture(GL_TEXTURE_3D, id);
     // default border color is (0, 0, 0, 0)
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
@@ -112,30 +155,51 @@ Texture3DImpl::Texture3DImpl(const std::string& name, uint32_t w, uint32_t h, ui
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexImage3D(GL_TEXTURE_3D, 0, internal_format, w, h, d, 0, format, type, data);
     if (mipmap) glGenerateMipmap(GL_TEXTURE_3D);
-    glBindTexture(GL_TEXTURE_3D, 0);
+    GLState::bind_texture(GL_TEXTURE_3D, 0);
 }
 
 Texture3DImpl::~Texture3DImpl() {
-    if (glIsTexture(id))
-        glDeleteTextures(1, &id);
+    gl_delete_deferred(GLObject::TEXTURE, id);
 }
 
 void Texture3DImpl::resize(uint32_t w, uint32_t h, uint32_t d) {
     this->w = w;
     this->h = h;
     this->d = d;
-    glBindTexture(GL_TEXTURE_3D, id);
+    if (GLState::dsa) {
+        // immutable storage can't be respecified, so replace the texture object (keeping the mipmap setting)
+        GLint min_filter = GL_LINEAR;
+        glGetTextureParameteriv(id, GL_TEXTURE_MIN_FILTER, &min_filter);
+        return allocate_immutable(0, min_filter != GL_LINEAR && min_filter != GL_NEAREST);
+    }
+    GLState::bind_texture(GL_TEXTURE_3D, id);
     glTexImage3D(GL_TEXTURE_3D, 0, internal_format, w, h, d, 0, format, type, 0);
-    glBindTexture(GL_TEXTURE_3D, 0);
+    GLState::bind_texture(GL_TEXTURE_3D, 0);
+}
+
+void Texture3DImpl::allocate_immutable(const void* data, bool mipmap) {
+    if (id) gl_delete_deferred(GLObject::TEXTURE, id);
+    glCreateTextures(GL_TEXTURE_3D, 1, &id);
+    // default border color is (0, 0, 0, 0)
+    glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTextureParameteri(id, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+    glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    if (w <= 0 || h <= 0 || d <= 0) return; // empty storage is invalid
+    glTextureStorage3D(id, mipmap ? mip_levels(w, h, d) : 1, sized_internal_format(internal_format, type), w, h, d);
+    if (data) {
+        glTextureSubImage3D(id, 0, 0, 0, 0, w, h, d, format, type, data);
+        if (mipmap) glGenerateTextureMipmap(id);
+    }
 }
 
 void Texture3DImpl::bind(uint32_t unit) const {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_3D, id);
+    GLState::bind_texture(unit, GL_TEXTURE_3D, id);
 }
 
 void Texture3DImpl::unbind() const {
-    glBindTexture(GL_TEXTURE_3D, 0);
+    GLState::bind_texture(GL_TEXTURE_3D, 0);
 }
 
 void Texture3DImpl::bind_image(uint32_t unit, GLenum access, GLenum format) const {
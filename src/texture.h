@@ -6,8 +6,12 @@ namespace fs = std::filesystem;
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include "named_handle.h"
+#include "image_load_store.h"
+#include "gl_state.h"
 #include <vector>
 #include <math.h>
+#include <cmath>
+#include <algorithm>
 
 CPPGL_NAMESPACE_BEGIN
 
@@ -45,6 +49,27 @@ static inline GLint channels_to_internal_format(GLenum type, uint32_t channels)
     }
 }
 
+// immutable storage requires sized internal formats, so derive one from unsized formats
+static inline GLint sized_internal_format(GLint internal_format, GLenum type) {
+    switch (internal_format) {
+        case GL_DEPTH_COMPONENT:
+            return type == GL_FLOAT ? GL_DEPTH_COMPONENT32F : type == GL_UNSIGNED_SHORT ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+        case GL_DEPTH_STENCIL:
+            return type == GL_FLOAT_32_UNSIGNED_INT_24_8_REV ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+        case GL_RED:
+        case GL_RG:
+        case GL_RGB:
+        case GL_RGBA:
+            return channels_to_internal_format(type, format_to_channels(internal_format));
+        default:
+            return internal_format;
+    }
+}
+// number of levels of a full mip chain
+static inline GLsizei mip_levels(uint32_t w, uint32_t h, uint32_t d = 1) {
+    return 1 + GLsizei(std::floor(std::log2(float(std::max(w, std::max(h, d))))));
+}
+
 static inline size_t GLenum_to_typesize(const GLenum type){
   // GL_UNSIGNED_BYTE, GL_BYTE, GL_UNSIGNED_SHORT, GL_SHORT, GL_UNSIGNED_INT, GL_INT, GL_HALF_FLOAT, GL_FLOAT
 
@@ -89,6 +114,8 @@ class Texture2DImpl {
 public:
     // construct from image on disk
     Texture2DImpl(const std::string& name, const fs::path& path, bool mipmap = true);
+    // construct from already decoded image (see image_load)
+    Texture2DImpl(const std::string& name, const fs::path& path, const ImageData& image, bool mipmap = true);
     // construct empty texture or from raw data
     Texture2DImpl(const std::string& name, uint32_t w, uint32_t h, GLint internal_format, GLenum format, GLenum type,
             const void* data = 0, bool mipmap = false);
@@ -103,8 +130,13 @@ public:
     inline operator GLuint() const { return id; }
 
     // resize (discards all data!)
+    // with the DSA backend this recreates the GL texture object, i.e. the id changes
     void resize(uint32_t w, uint32_t h);
 
+    // DSA backend: create a new GL texture object with immutable storage of the current size and format (discards all data!)
+    // a previous texture object is deleted once the GPU is done with it
+    void allocate_immutable(const void* data = 0, bool mipmap = false);
+
     // bind/unbind to/from OpenGL
     void bind(uint32_t uint) const;
     void unbind() const;
@@ -118,11 +150,11 @@ public:
 
         destination.clear();
         destination.resize(w * h * format_to_channels(format));
-        glBindTexture(GL_TEXTURE_2D, id);
+        GLState::bind_texture(GL_TEXTURE_2D, id);
         glGetTexImage(GL_TEXTURE_2D, 0, format, 
             std::is_same<T, float>::value ? GL_FLOAT : GL_UNSIGNED_BYTE,
             &destination[0]);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLState::bind_texture(GL_TEXTURE_2D, 0);
     }
 
     template <typename T>
@@ -131,25 +163,31 @@ public:
 
         destination.clear();
         destination.resize((w/std::pow(2.0, level)) * (h/std::pow(2.0, level)) * format_to_channels(format));
-        glBindTexture(GL_TEXTURE_2D, id);
+        GLState::bind_texture(GL_TEXTURE_2D, id);
         glGetTexImage(GL_TEXTURE_2D, level, format, 
             std::is_same<T, float>::value ? GL_FLOAT : GL_UNSIGNED_BYTE,
             &destination[0]);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLState::bind_texture(GL_TEXTURE_2D, 0);
     }
 
     template <typename T>
     void copy_to_gpu(const std::vector<T>& source, bool mipmap= false) {
         static_assert((std::is_same<T, float>::value && type == GL_FLOAT) || (std::is_same<T, uint8_t>::value && type == GL_UNSIGNED_BYTE), "bad type bro: needs to be either float or uint8_t!");
 
-        glBindTexture(GL_TEXTURE_2D, id);
+        if (GLState::dsa) {
+            // storage is immutable, so only update the contents
+            glTextureSubImage2D(id, 0, 0, 0, w, h, format, type, source.data());
+            if (mipmap) glGenerateTextureMipmap(id);
+            return;
+        }
+        GLState::bind_texture(GL_TEXTURE_2D, id);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
         glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, type, source.data());
         if (mipmap) glGenerateMipmap(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLState::bind_texture(GL_TEXTURE_2D, 0);
     }
 
     // save to disk
@@ -157,7 +195,7 @@ public:
 
     // data
     const std::string name;
-    const fs::path loaded_from_path;
+    fs::path loaded_from_path;
     GLuint id;
     int w, h;
     GLint internal_format;
@@ -185,8 +223,12 @@ public:
     inline operator GLuint() const { return id; }
 
     // resize (discards all data!)
+    // with the DSA backend this recreates the GL texture object, i.e. the id changes
     void resize(uint32_t w, uint32_t h, uint32_t d);
 
+    // DSA backend: create a new GL texture object with immutable storage of the current size and format (discards all data!)
+    void allocate_immutable(const void* data = 0, bool mipmap = false);
+
     // bind/unbind to/from OpenGL
     void bind(uint32_t uint) const;
     void unbind() const;
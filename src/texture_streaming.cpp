@@ -0,0 +1,229 @@
+#include "texture_streaming.h"
+#include <deque>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <optional>
+#include <iostream>
+#include "buffer.h"
+#include "gl_state.h"
+#include "thread_pool.h"
+#include "image_load_store.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+static const size_t STAGING_RING_SIZE = 64 * 1024 * 1024;
+static const size_t STAGING_ALIGNMENT = 256;
+
+// ------------------------------------------
+// Staging ring (persistently mapped PUBO, regions are reused once their fence has passed)
+
+class StagingRing {
+public:
+    StagingRing(size_t size) : capacity(0), head(0), ptr(0) {
+        if (!GLEW_ARB_buffer_storage) {
+            std::cerr << "WARN: TextureStreaming: ARB_buffer_storage not supported, falling back to direct uploads!" << std::endl;
+            return;
+        }
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        pbo = PUBO("texture_streaming_staging_ring");
+        pbo->storage(0, size, flags);
+        ptr = (uint8_t*)pbo->map_range(0, size, flags);
+        pbo->unbind();
+        capacity = ptr ? size : 0;
+    }
+    ~StagingRing() {
+        for (const auto& region : in_flight)
+            glDeleteSync(region.fence);
+        if (ptr) pbo->unmap();
+        if (pbo) PUBO::erase(pbo->name);
+    }
+
+    // reclaim regions the GPU is done with (optionally wait for the oldest one)
+    void retire(bool block = false) {
+        while (!in_flight.empty()) {
+            const GLenum status = glClientWaitSync(in_flight.front().fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, block ? 1000000000 : 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+            glDeleteSync(in_flight.front().fence);
+            in_flight.pop_front();
+            block = false;
+        }
+    }
+
+    // find free region of given size (returns false if the ring is too full right now)
+    bool allocate(size_t size, size_t& offset) {
+        size = (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+        if (size > capacity) return false;
+        retire();
+        if (in_flight.empty())
+            offset = 0;
+        else {
+            const size_t tail = in_flight.front().begin;
+            if (head > tail && head + size <= capacity)
+                offset = head;
+            else if (head > tail && size <= tail)
+                offset = 0; // wrap around
+            else if (head < tail && head + size <= tail)
+                offset = head;
+            else
+                return false;
+        }
+        head = offset + size;
+        return true;
+    }
+
+    // mark region as in use until the GPU passed all commands issued so far
+    void fence(size_t offset) {
+        in_flight.push_back(Region{ offset, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+    }
+
+    // data
+    struct Region {
+        size_t begin;
+        GLsync fence;
+    };
+    size_t capacity, head;
+    uint8_t* ptr;
+    PUBO pbo;
+    std::deque<Region> in_flight;
+};
+
+// created on first use, released by texture_streaming_shutdown() while the context is still alive
+static std::unique_ptr<StagingRing> staging;
+
+static StagingRing& staging_ring() {
+    if (!staging)
+        staging = std::make_unique<StagingRing>(STAGING_RING_SIZE);
+    return *staging;
+}
+
+// ------------------------------------------
+// Streaming jobs
+
+struct StreamJob {
+    Texture2D tex;
+    bool mipmap;
+    std::future<ImageData> image;
+    std::optional<ImageData> decoded;
+};
+
+static std::deque<StreamJob> jobs;
+static size_t budget = 16 * 1024 * 1024;
+
+static bool upload(StreamJob& job) {
+    const auto& [data, w, h, channels, is_hdr] = *job.decoded;
+    StagingRing& ring = staging_ring();
+    size_t offset = 0;
+    const bool staged = ring.allocate(data.size(), offset);
+    if (!staged && data.size() <= ring.capacity)
+        return false; // ring is full, retry next frame
+    // update texture in place
+    Texture2DImpl& tex = *job.tex;
+    tex.w = w;
+    tex.h = h;
+    tex.internal_format = is_hdr ? channels_to_float_format(channels) : channels_to_ubyte_format(channels);
+    tex.format = channels_to_format(channels);
+    tex.type = is_hdr ? GL_FLOAT : GL_UNSIGNED_BYTE;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    if (GLState::dsa) {
+        // immutable storage of the placeholder can't be respecified, so swap in a new texture object
+        tex.allocate_immutable(0, job.mipmap);
+        if (staged) {
+            std::memcpy(ring.ptr + offset, data.data(), data.size());
+            ring.pbo->bind();
+            glTextureSubImage2D(tex.id, 0, 0, 0, w, h, tex.format, tex.type, (const void*)offset);
+            ring.pbo->unbind();
+            ring.fence(offset);
+        } else
+            glTextureSubImage2D(tex.id, 0, 0, 0, w, h, tex.format, tex.type, data.data());
+        if (job.mipmap) glGenerateTextureMipmap(tex.id);
+        return true;
+    }
+    GLState::bind_texture(GL_TEXTURE_2D, tex.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, job.mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    if (staged) {
+        // copy into mapped staging memory and source the upload from the PBO
+        std::memcpy(ring.ptr + offset, data.data(), data.size());
+        ring.pbo->bind();
+        glTexImage2D(GL_TEXTURE_2D, 0, tex.internal_format, w, h, 0, tex.format, tex.type, (const void*)offset);
+        ring.pbo->unbind();
+        ring.fence(offset);
+    } else // too large for the staging ring
+        glTexImage2D(GL_TEXTURE_2D, 0, tex.internal_format, w, h, 0, tex.format, tex.type, data.data());
+    if (job.mipmap) glGenerateMipmap(GL_TEXTURE_2D);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+// ------------------------------------------
+// Asynchronous texture streaming
+
+Texture2D load_texture_async(const std::string& name, const fs::path& path, bool mipmap) {
+    static const uint8_t placeholder[4] = { 128, 128, 128, 255 };
+    Texture2D tex(name, 1, 1, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    tex->loaded_from_path = path;
+    jobs.push_back(StreamJob{ tex, mipmap, ThreadPool::global().enqueue([path]() { return image_load(path); }), std::nullopt });
+    return tex;
+}
+
+void texture_streaming_update() {
+    size_t uploaded = 0;
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        // fetch decoded image
+        if (!it->decoded) {
+            if (it->image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++it;
+                continue;
+            }
+            try {
+                it->decoded = it->image.get();
+            } catch (std::exception& e) {
+                std::cerr << "WARN: TextureStreaming: " << e.what() << std::endl;
+                it = jobs.erase(it);
+                continue;
+            }
+        }
+        // upload within budget
+        const size_t size_bytes = std::get<0>(*it->decoded).size();
+        if (uploaded > 0 && uploaded + size_bytes > budget) break;
+        if (!upload(*it)) break;
+        uploaded += size_bytes;
+        it = jobs.erase(it);
+    }
+}
+
+void texture_streaming_finish() {
+    const size_t prev_budget = budget;
+    budget = SIZE_MAX;
+    while (!jobs.empty()) {
+        for (auto& job : jobs)
+            if (!job.decoded) job.image.wait();
+        texture_streaming_update();
+        if (!jobs.empty())
+            staging_ring().retire(true);
+    }
+    budget = prev_budget;
+}
+
+size_t texture_streaming_pending() {
+    return jobs.size();
+}
+
+void texture_streaming_set_budget(size_t bytes_per_frame) {
+    budget = bytes_per_frame;
+}
+
+void texture_streaming_shutdown() {
+    jobs.clear();
+    if (!staging) return;
+    while (!staging->in_flight.empty())
+        staging->retire(true);
+    staging.reset();
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <filesystem>
+namespace fs = std::filesystem;
+#include "texture.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Asynchronous texture streaming
+// Images are decoded on the global thread pool and uploaded through a ring of persistently mapped pixel unpack buffers.
+// Returned textures hold a 1x1 placeholder until the image is resident, uploads are limited by a per-frame byte budget.
+// Note: all functions have to be called from the context thread.
+
+// start loading texture from disk (returns immediately with a placeholder texture, which is updated in place)
+Texture2D load_texture_async(const std::string& name, const fs::path& path, bool mipmap = true);
+
+// upload decoded images within the per-frame budget (called once per frame by Context::swap_buffers)
+void texture_streaming_update();
+// block until all pending textures are resident
+void texture_streaming_finish();
+
+// amount of textures still waiting to be decoded or uploaded
+size_t texture_streaming_pending();
+// max. bytes uploaded per frame (default: 16MB, at least one texture is uploaded per frame)
+void texture_streaming_set_budget(size_t bytes_per_frame);
+
+// drop pending textures and release the staging ring (called by Context::~Context before the context is destroyed)
+void texture_streaming_shutdown();
+
+CPPGL_NAMESPACE_END
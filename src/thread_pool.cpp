@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+#include <atomic>
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+static thread_local bool in_worker_thread = false;
+
+// ------------------------------------------
+// ThreadPool
+
+ThreadPool::ThreadPool(size_t num_threads) : stop(false) {
+    num_threads = std::max<size_t>(1, num_threads);
+    for (size_t i = 0; i < num_threads; ++i)
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+size_t ThreadPool::num_queued() const {
+    const std::lock_guard<std::mutex> lock(mutex);
+    return tasks.size();
+}
+
+bool ThreadPool::is_worker_thread() {
+    return in_worker_thread;
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::worker_loop() {
+    in_worker_thread = true;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stop || !tasks.empty(); });
+            if (stop && tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+// ------------------------------------------
+// parallel_for
+
+void parallel_for(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0) return;
+    if (n == 1 || ThreadPool::is_worker_thread()) {
+        for (size_t i = 0; i < n; ++i)
+            fn(i);
+        return;
+    }
+    // workers and calling thread grab indices until exhausted
+    std::atomic<size_t> next(0);
+    std::mutex exception_mutex;
+    std::exception_ptr exception;
+    const auto work = [&]() {
+        for (size_t i = next++; i < n; i = next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                const std::lock_guard<std::mutex> lock(exception_mutex);
+                if (!exception) exception = std::current_exception();
+            }
+        }
+    };
+    ThreadPool& pool = ThreadPool::global();
+    std::vector<std::future<void>> helpers;
+    for (size_t i = 0; i < std::min(n - 1, pool.num_threads()); ++i)
+        helpers.push_back(pool.enqueue(work));
+    work();
+    for (auto& helper : helpers)
+        helper.wait();
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <future>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// ThreadPool (fixed set of worker threads processing a FIFO task queue)
+// Note: workers have no GL context, so tasks must not call into GL!
+
+class ThreadPool {
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency());
+    virtual ~ThreadPool(); // finishes all queued tasks before joining
+
+    // prevent copies and moves, since worker threads reference this object
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&&) = delete;
+
+    // enqueue task, the returned future holds its result (or exception)
+    template <typename F> auto enqueue(F&& fn) -> std::future<decltype(fn())> {
+        using R = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        std::future<R> future = task->get_future();
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([task]() { (*task)(); });
+        }
+        cv.notify_one();
+        return future;
+    }
+
+    // amount of tasks not yet picked up by a worker
+    size_t num_queued() const;
+    inline size_t num_threads() const { return workers.size(); }
+
+    // check if the calling thread is a worker of any pool
+    static bool is_worker_thread();
+
+    // global pool shared by loaders (created on first use, one worker per hardware thread)
+    static ThreadPool& global();
+
+private:
+    void worker_loop();
+
+    // data
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    bool stop;
+};
+
+// call fn(i) for all i in [0, n) on the global pool, the calling thread helps out and blocks until all calls finished
+// Note: the first exception thrown by fn is rethrown on the calling thread, nested calls from worker threads run serially
+void parallel_for(size_t n, const std::function<void(size_t)>& fn);
+
+CPPGL_NAMESPACE_END
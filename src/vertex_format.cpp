@@ -0,0 +1,278 @@
+#include "vertex_format.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "buffer.h"
+#include "geometry.h"
+#include "thread_pool.h"
+#if defined(__SSE4_1__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+CPPGL_NAMESPACE_BEGIN
+
+static const size_t ENCODE_BLOCK_SIZE = 1 << 16;
+
+// ------------------------------------------
+// helper funcs
+
+static inline uint32_t attribute_size(const VertexAttribute& attrib) {
+    return type_to_bytes(attrib.type) * attrib.dim;
+}
+
+static inline uint16_t float_to_half(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const int32_t exp = int32_t((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = x & 0x7fffff;
+    if (((x >> 23) & 0xff) == 0xff) // inf or nan
+        return uint16_t(sign | 0x7c00 | (mant ? 0x200 : 0));
+    if (exp >= 31) // overflow
+        return uint16_t(sign | 0x7c00);
+    if (exp <= 0) { // subnormal or zero
+        if (exp < -10) return uint16_t(sign);
+        mant |= 0x800000;
+        const uint32_t shift = 14 - exp;
+        uint32_t h = mant >> shift;
+        if ((mant >> (shift - 1)) & 1) h++; // round to nearest
+        return uint16_t(sign | h);
+    }
+    uint32_t h = sign | (uint32_t(exp) << 10) | (mant >> 13);
+    if (mant & 0x1000) h++; // round to nearest, carry into exponent is intended
+    return uint16_t(h);
+}
+
+static inline uint16_t float_to_unorm16(float f) {
+    return uint16_t(std::min(std::max(f, 0.f), 1.f) * 65535.f + 0.5f);
+}
+
+static inline int16_t float_to_snorm16(float f) {
+    return int16_t(std::round(std::min(std::max(f, -1.f), 1.f) * 32767.f));
+}
+
+static inline void octahedral_encode(const glm::vec3& n, float& u, float& v) {
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 <= 0.f) {
+        u = v = 0.f;
+        return;
+    }
+    u = n.x / l1;
+    v = n.y / l1;
+    if (n.z < 0.f) { // fold lower hemisphere
+        const float fu = (1.f - std::abs(v)) * (u >= 0.f ? 1.f : -1.f);
+        const float fv = (1.f - std::abs(u)) * (v >= 0.f ? 1.f : -1.f);
+        u = fu;
+        v = fv;
+    }
+}
+
+// ------------------------------------------
+// per-attribute encoders (strided output)
+
+static void encode_positions(const glm::vec3* src, size_t count, uint8_t* dst, uint32_t stride, PositionEncoding encoding, const glm::vec3& bb_min, const glm::vec3& inv_extent) {
+    if (encoding == PositionEncoding::FLOAT32) {
+        for (size_t i = 0; i < count; ++i)
+            std::memcpy(dst + i * stride, &src[i], sizeof(glm::vec3));
+        return;
+    }
+#ifdef __SSE4_1__
+    const __m128 offset = _mm_set_ps(0.f, bb_min.z, bb_min.y, bb_min.x);
+    const __m128 scale = _mm_set_ps(65535.f, inv_extent.z * 65535.f, inv_extent.y * 65535.f, inv_extent.x * 65535.f);
+    const __m128 half = _mm_set1_ps(0.5f), lo = _mm_setzero_ps(), hi = _mm_set1_ps(65535.f);
+    for (size_t i = 0; i < count; ++i) {
+        __m128 p = _mm_set_ps(1.f, src[i].z, src[i].y, src[i].x);
+        p = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(p, offset), scale), half);
+        p = _mm_min_ps(_mm_max_ps(p, lo), hi);
+        const __m128i q = _mm_cvttps_epi32(p);
+        _mm_storel_epi64((__m128i*)(dst + i * stride), _mm_packus_epi32(q, q));
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        const glm::vec3 p = (src[i] - bb_min) * inv_extent;
+        const uint16_t q[4] = { float_to_unorm16(p.x), float_to_unorm16(p.y), float_to_unorm16(p.z), 65535 };
+        std::memcpy(dst + i * stride, q, sizeof(q));
+    }
+#endif
+}
+
+static void encode_normals(const glm::vec3* src, size_t count, uint8_t* dst, uint32_t stride, NormalEncoding encoding) {
+    if (encoding == NormalEncoding::FLOAT32) {
+        for (size_t i = 0; i < count; ++i)
+            std::memcpy(dst + i * stride, &src[i], sizeof(glm::vec3));
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        float u, v;
+        octahedral_encode(src[i], u, v);
+        const int16_t q[2] = { float_to_snorm16(u), float_to_snorm16(v) };
+        std::memcpy(dst + i * stride, q, sizeof(q));
+    }
+}
+
+static void encode_texcoords(const glm::vec2* src, size_t count, uint8_t* dst, uint32_t stride, TexcoordEncoding encoding) {
+    if (encoding == TexcoordEncoding::FLOAT32) {
+        for (size_t i = 0; i < count; ++i)
+            std::memcpy(dst + i * stride, &src[i], sizeof(glm::vec2));
+    } else if (encoding == TexcoordEncoding::HALF_FLOAT) {
+#ifdef __F16C__
+        for (size_t i = 0; i < count; ++i) {
+            const __m128i h = _mm_cvtps_ph(_mm_set_ps(0.f, 0.f, src[i].y, src[i].x), _MM_FROUND_TO_NEAREST_INT);
+            const int32_t packed = _mm_cvtsi128_si32(h);
+            std::memcpy(dst + i * stride, &packed, sizeof(packed));
+        }
+#else
+        for (size_t i = 0; i < count; ++i) {
+            const uint16_t q[2] = { float_to_half(src[i].x), float_to_half(src[i].y) };
+            std::memcpy(dst + i * stride, q, sizeof(q));
+        }
+#endif
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            const uint16_t q[2] = { float_to_unorm16(src[i].x), float_to_unorm16(src[i].y) };
+            std::memcpy(dst + i * stride, q, sizeof(q));
+        }
+    }
+}
+
+// ------------------------------------------
+// Vertex layout
+
+void set_vertex_attrib_pointers(const VertexStream& stream) {
+    for (const auto& attrib : stream.attributes) {
+        const GLenum type = attrib.type;
+        const void* offset = (const void*)size_t(attrib.offset);
+        glEnableVertexAttribArray(attrib.location);
+        if (!attrib.normalized && (type == GL_BYTE || type == GL_UNSIGNED_BYTE ||
+                type == GL_SHORT || type == GL_UNSIGNED_SHORT ||
+                type == GL_INT || type == GL_UNSIGNED_INT))
+            glVertexAttribIPointer(attrib.location, attrib.dim, type, stream.stride, offset);
+        else if (type == GL_DOUBLE)
+            glVertexAttribLPointer(attrib.location, attrib.dim, type, stream.stride, offset);
+        else
+            glVertexAttribPointer(attrib.location, attrib.dim, type, attrib.normalized ? GL_TRUE : GL_FALSE, stream.stride, offset);
+    }
+}
+
+// ------------------------------------------
+// VertexFormat
+
+VertexFormat VertexFormat::separate() {
+    return VertexFormat();
+}
+
+VertexFormat VertexFormat::interleaved_float() {
+    VertexFormat format;
+    format.interleaved = true;
+    return format;
+}
+
+VertexFormat VertexFormat::compressed() {
+    VertexFormat format;
+    format.interleaved = true;
+    format.position = PositionEncoding::UNORM16;
+    format.normal = NormalEncoding::OCTAHEDRAL_SNORM16;
+    format.texcoord = TexcoordEncoding::HALF_FLOAT;
+    return format;
+}
+
+std::vector<VertexStream> VertexFormat::layout(bool has_normals, bool has_texcoords) const {
+    // attributes in location order (all sizes are multiples of 4 bytes to keep interleaved attributes aligned)
+    std::vector<VertexAttribute> attributes;
+    uint32_t location = 0;
+    if (position == PositionEncoding::FLOAT32)
+        attributes.push_back({ location++, GL_FLOAT, 3, false, 0 });
+    else
+        attributes.push_back({ location++, GL_UNSIGNED_SHORT, 4, true, 0 }); // w is padding (1.0)
+    if (has_normals) {
+        if (normal == NormalEncoding::FLOAT32)
+            attributes.push_back({ location++, GL_FLOAT, 3, false, 0 });
+        else
+            attributes.push_back({ location++, GL_SHORT, 2, true, 0 });
+    }
+    if (has_texcoords) {
+        if (texcoord == TexcoordEncoding::FLOAT32)
+            attributes.push_back({ location++, GL_FLOAT, 2, false, 0 });
+        else if (texcoord == TexcoordEncoding::HALF_FLOAT)
+            attributes.push_back({ location++, GL_HALF_FLOAT, 2, false, 0 });
+        else
+            attributes.push_back({ location++, GL_UNSIGNED_SHORT, 2, true, 0 });
+    }
+    // distribute over streams
+    std::vector<VertexStream> streams;
+    if (interleaved) {
+        VertexStream stream = { 0, {} };
+        for (auto attrib : attributes) {
+            attrib.offset = stream.stride;
+            stream.stride += attribute_size(attrib);
+            stream.attributes.push_back(attrib);
+        }
+        streams.push_back(stream);
+    } else {
+        for (const auto& attrib : attributes)
+            streams.push_back(VertexStream{ attribute_size(attrib), { attrib } });
+    }
+    return streams;
+}
+
+std::string VertexFormat::key(bool has_normals, bool has_texcoords) const {
+    std::string key = interleaved ? "i" : "s";
+    key += "_p" + std::to_string(int(position));
+    if (has_normals) key += "_n" + std::to_string(int(normal));
+    if (has_texcoords) key += "_t" + std::to_string(int(texcoord));
+    return key;
+}
+
+// ------------------------------------------
+// Vertex encoding
+
+std::vector<std::vector<uint8_t>> encode_vertices(const GeometryImpl& geometry, const VertexFormat& format, glm::mat4& position_decode) {
+    const bool has_normals = geometry.has_normals(), has_texcoords = geometry.has_texcoords();
+    const std::vector<VertexStream> streams = format.layout(has_normals, has_texcoords);
+    const size_t num_vertices = geometry.positions.size();
+    std::vector<std::vector<uint8_t>> data(streams.size());
+    for (size_t i = 0; i < streams.size(); ++i)
+        data[i].resize(streams[i].stride * num_vertices);
+
+    // destination (base pointer + stride) per attribute, layout() emits them in location order
+    std::vector<std::pair<uint8_t*, uint32_t>> targets;
+    for (size_t i = 0; i < streams.size(); ++i)
+        for (const auto& attrib : streams[i].attributes)
+            targets.emplace_back(data[i].data() + attrib.offset, streams[i].stride);
+
+    // quantization range
+    position_decode = glm::mat4(1);
+    glm::vec3 bb_min(0), inv_extent(1);
+    if (format.position == PositionEncoding::UNORM16 && num_vertices > 0) {
+        bb_min = geometry.positions[0];
+        glm::vec3 bb_max = geometry.positions[0];
+        for (const auto& p : geometry.positions) {
+            bb_min = glm::min(bb_min, p);
+            bb_max = glm::max(bb_max, p);
+        }
+        const glm::vec3 extent = glm::max(bb_max - bb_min, glm::vec3(1e-20f));
+        inv_extent = 1.f / extent;
+        position_decode[0][0] = extent.x;
+        position_decode[1][1] = extent.y;
+        position_decode[2][2] = extent.z;
+        position_decode[3] = glm::vec4(bb_min, 1.f);
+    }
+
+    // encode in blocks
+    const size_t num_blocks = (num_vertices + ENCODE_BLOCK_SIZE - 1) / ENCODE_BLOCK_SIZE;
+    parallel_for(num_blocks, [&](size_t b) {
+        const size_t begin = b * ENCODE_BLOCK_SIZE, count = std::min(num_vertices - begin, ENCODE_BLOCK_SIZE);
+        size_t t = 0;
+        encode_positions(geometry.positions.data() + begin, count, targets[t].first + begin * targets[t].second, targets[t].second, format.position, bb_min, inv_extent);
+        ++t;
+        if (has_normals) {
+            encode_normals(geometry.normals.data() + begin, count, targets[t].first + begin * targets[t].second, targets[t].second, format.normal);
+            ++t;
+        }
+        if (has_texcoords)
+            encode_texcoords(geometry.texcoords.data() + begin, count, targets[t].first + begin * targets[t].second, targets[t].second, format.texcoord);
+    });
+    return data;
+}
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+class GeometryImpl;
+
+// ------------------------------------------
+// Vertex layout description (attributes of one vertex buffer)
+
+struct VertexAttribute {
+    uint32_t location; // attribute location in shader
+    GLenum type;
+    uint32_t dim;
+    bool normalized; // fixed point types are mapped to [0, 1] (unsigned) or [-1, 1] (signed)
+    uint32_t offset; // in bytes
+};
+
+struct VertexStream {
+    uint32_t stride; // in bytes
+    std::vector<VertexAttribute> attributes;
+};
+
+// set attribute pointers for given stream (expects the VAO and the stream's VBO to be bound)
+void set_vertex_attrib_pointers(const VertexStream& stream);
+
+// ------------------------------------------
+// Vertex format (how geometry is encoded for upload)
+// Attribute locations: positions = 0, normals = 1 (if present), texcoords = next free location (if present).
+// Encodings and the expected shader inputs:
+//  FLOAT32:            vecN as usual
+//  UNORM16 positions:  quantized against the AABB, decoding is baked into MeshImpl::position_decode (so in vec3 works)
+//  OCTAHEDRAL normals: vec2 in [-1, 1], decode via decode_octahedral() from shader/vertex_format.glsl
+//  HALF_FLOAT / UNORM16 texcoords: vec2 as usual (UNORM16 clamps to [0, 1], so no tiling!)
+
+enum class PositionEncoding { FLOAT32, UNORM16 };
+enum class NormalEncoding { FLOAT32, OCTAHEDRAL_SNORM16 };
+enum class TexcoordEncoding { FLOAT32, HALF_FLOAT, UNORM16 };
+
+struct VertexFormat {
+    bool interleaved = false;
+    PositionEncoding position = PositionEncoding::FLOAT32;
+    NormalEncoding normal = NormalEncoding::FLOAT32;
+    TexcoordEncoding texcoord = TexcoordEncoding::FLOAT32;
+
+    // presets
+    static VertexFormat separate();             // one float stream per attribute (32 bytes per vertex, default)
+    static VertexFormat interleaved_float();    // single interleaved float stream (32 bytes per vertex)
+    static VertexFormat compressed();           // interleaved unorm16 positions, octahedral normals, half float texcoords (16 bytes per vertex)
+
+    // buffer layout for geometry with or without normals/texcoords
+    std::vector<VertexStream> layout(bool has_normals, bool has_texcoords) const;
+    // unique string for this format and attribute set (e.g. to share buffers between meshes)
+    std::string key(bool has_normals, bool has_texcoords) const;
+
+    inline bool operator==(const VertexFormat& other) const {
+        return interleaved == other.interleaved && position == other.position && normal == other.normal && texcoord == other.texcoord;
+    }
+    inline bool operator!=(const VertexFormat& other) const { return !(*this == other); }
+};
+
+// encode geometry into one byte buffer per stream of format.layout()
+// position_decode is set to the transform from encoded to object space positions (identity unless positions are quantized)
+// Note: uses F16C/SSE4.1 if available and splits large geometries across the global thread pool
+std::vector<std::vector<uint8_t>> encode_vertices(const GeometryImpl& geometry, const VertexFormat& format, glm::mat4& position_decode);
+
+CPPGL_NAMESPACE_END